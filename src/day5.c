@@ -1,4 +1,4 @@
-/* jolt -- [AOC 2025 Day 3] Find the largest possible joltage from a set of battery banks.
+/* day5 -- [AOC 2025 Day 5] Count the fresh ingredients in an inventory.
    Copyright (C) 2025 99xtal
 
    This program is free software: you can redistribute it and/or modify
@@ -14,115 +14,917 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <getopt.h>
+#include <limits.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+__extension__ typedef unsigned __int128 uint128;
+
+// bits sorted per radix pass, 8 passes cover a 64-bit key
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+// Compare 64-bit lanes as vectors only where the target has instructions
+// for it; elsewhere GCC compares lane by lane and the scalar loop wins. The
+// limits are the interval counts up to which scanning beats the tree.
+#if defined(__AVX2__) || defined(__aarch64__)
+#define HAVE_LONG_VEC_COMPARE 1
+#define LINEAR_SCAN_MAX 16
+#else
+#define LINEAR_SCAN_MAX 8
+#endif
+
+#define INDEX_MAGIC "DAY5IDX"
+#define INDEX_VERSION 1
+
+// IDs compared at once by the linear scan
+#define VEC_LONGS 4
+
+typedef long long_vec_unaligned
+    __attribute__((vector_size(VEC_LONGS * sizeof(long)), aligned(8), may_alias));
+
+// VEC_LONGS longs starting at values
+#define LOAD_LONGS(values) (*(const long_vec_unaligned *)(values))
+
+struct config {
+    int count_fresh;
+    int batch;
+    int ops;
+};
+
+// what solve found in one FILE
+struct result {
+    long fresh_count;
+    uint128 fresh_ids;
+};
+
+// fresh ranges as read, bounds of range i at lo[i] and hi[i]
+struct ranges {
+    long *lo;
+    long *hi;
+    size_t len;
+    size_t capacity;
+};
+
+// inclusive range of fresh ingredient IDs
+struct interval {
+    long lo;
+    long hi;
+};
+
+// Merged intervals in Eytzinger order: node k has children 2k and 2k + 1,
+// and visiting the nodes in order gives the intervals sorted. A search
+// walks down from node 1, so the top levels stay cached. Node 0 is unused.
+struct interval_tree {
+    const long *his;
+    const long *los;
+    size_t len;
+};
+
+// Merged fresh ranges, sorted and as a tree, either built from the range
+// section of the input or mapped from an index file.
+struct interval_set {
+    const struct interval *intervals;
+    size_t len;
+    struct interval_tree tree;
+    void *map;
+    size_t map_size;
+};
+
+// Interval of a set that changes as operations arrive. The intervals are
+// disjoint and kept in a treap: a search tree by lo that is also a heap by
+// a random priority, which keeps it balanced in expectation.
+struct interval_node {
+    long lo;
+    long hi;
+    unsigned long priority;
+    struct interval_node *left;
+    struct interval_node *right;
+};
+
+struct dynamic_set {
+    struct interval_node *root;
+    uint128 covered;
+    unsigned long seed;
+};
+
+// On-disk interval set written by --build-index, in native byte order. The
+// header is followed by count sorted (lo, hi) pairs and then the tree's
+// count + 1 his and count + 1 los, so nothing is computed when it is mapped.
+struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t count;
+};
 
 void usage(FILE *out, const char *prog) {
     fprintf(out,
         "Usage: %s [OPTION]... [FILE]...\n"
         "\n"
-        "Given a FILE containing a list of battery bank joltages, find the largest possible joltage.\n"
+        "Given a FILE containing ranges of fresh ingredient IDs, a blank line and a list of\n"
+        "ingredient IDs, count how many of the ingredients are fresh.\n"
         "\n"
         "With no FILE, read standard input.\n"
         "\n"
         "Options:\n"
-        "   -n, --number      Specify number of batteries to turn on in each bank (default: 12)\n"
+        "   -c, --count-fresh Count every ID the fresh ranges cover instead, without\n"
+        "                     reading the ingredients\n"
+        "   -b, --batch       Read every ingredient first, sort them and match them against\n"
+        "                     the ranges in one pass\n"
+        "   -i, --index=FILE  Use the ranges in an index built with --build-index, each\n"
+        "                     FILE then only lists ingredient IDs\n"
+        "   -I, --build-index=FILE\n"
+        "                     Write the ranges of every FILE to index FILE and exit\n"
+        "   -o, --ops         Read FILE as operations on a changing set of ranges, one per\n"
+        "                     line: 'add L-U', 'remove L-U' or 'query ID', and count the\n"
+        "                     queried ingredients that were fresh when asked\n"
         "   -h, --help        Display this help and exit\n"
         "   -V, --version     Display version information and exit\n",
         prog
     );
 }
 
-void free_arr(long** arr, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        free(arr[i]);
+int ranges_push(struct ranges *ranges, long l_bound, long u_bound) {
+    // grow arrays if needed
+    if (ranges->len >= ranges->capacity) {
+        size_t capacity = ranges->capacity ? ranges->capacity * 2 : 16;
+        long *new_lo = realloc(ranges->lo, capacity * sizeof(long));
+        if (new_lo) {
+            ranges->lo = new_lo;
+        }
+        long *new_hi = realloc(ranges->hi, capacity * sizeof(long));
+        if (new_hi) {
+            ranges->hi = new_hi;
+        }
+        if (!new_lo || !new_hi) {
+            fprintf(stderr, "realloc failed\n");
+            return -1;
+        }
+        ranges->capacity = capacity;
+    }
+
+    ranges->lo[ranges->len] = l_bound;
+    ranges->hi[ranges->len] = u_bound;
+    ranges->len++;
+    return 0;
+}
+
+void ranges_free(struct ranges *ranges) {
+    free(ranges->lo);
+    free(ranges->hi);
+}
+
+int compare_intervals(const void *a, const void *b) {
+    const struct interval *x = a;
+    const struct interval *y = b;
+    return (x->lo > y->lo) - (x->lo < y->lo);
+}
+
+// Sort the ranges and merge the overlapping or adjacent ones, so that every
+// ID is in at most one interval. Returns the merged intervals, in order.
+struct interval *merge_ranges(const struct ranges *ranges, size_t *merged_len) {
+    struct interval *intervals = malloc((ranges->len + 1) * sizeof(struct interval));
+    if (!intervals) {
+        fprintf(stderr, "memory allocation failed\n");
+        return NULL;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < ranges->len; i++) {
+        // an empty range can never hold an ingredient
+        if (ranges->lo[i] <= ranges->hi[i]) {
+            intervals[count].lo = ranges->lo[i];
+            intervals[count].hi = ranges->hi[i];
+            count++;
+        }
+    }
+
+    qsort(intervals, count, sizeof(struct interval), compare_intervals);
+
+    size_t merged = count > 0 ? 1 : 0;
+    for (size_t i = 1; i < count; i++) {
+        struct interval *last = &intervals[merged - 1];
+        if (intervals[i].lo <= last->hi || (last->hi < LONG_MAX && intervals[i].lo == last->hi + 1)) {
+            if (intervals[i].hi > last->hi) {
+                last->hi = intervals[i].hi;
+            }
+        } else {
+            intervals[merged++] = intervals[i];
+        }
     }
-    free(arr);
+
+    *merged_len = merged;
+    return intervals;
 }
 
-long solve(FILE *input) {
-    size_t capacity = 16;
-    size_t len = 0;
-    
-    long** fresh_ing_ranges = malloc(capacity * sizeof(long*));
-    if (!fresh_ing_ranges) {
+// place the sorted intervals into the subtree of node k, returning how many
+// were placed
+size_t interval_tree_fill(long *his, long *los, size_t len, const struct interval *sorted, size_t k) {
+    if (k > len) {
+        return 0;
+    }
+
+    size_t placed = interval_tree_fill(his, los, len, sorted, 2 * k);
+    his[k] = sorted[placed].hi;
+    los[k] = sorted[placed].lo;
+    placed++;
+    return placed + interval_tree_fill(his, los, len, sorted + placed, 2 * k + 1);
+}
+
+int interval_tree_init(struct interval_tree *tree, const struct interval *sorted, size_t len) {
+    long *his = malloc((len + 1) * sizeof(long));
+    long *los = malloc((len + 1) * sizeof(long));
+    if (!his || !los) {
+        free(his);
+        free(los);
         fprintf(stderr, "memory allocation failed\n");
         return -1;
     }
 
-    char* line = NULL;
-    int linecap = 0;
-    int linelen;
-    int parsing_ranges = 1;
+    interval_tree_fill(his, los, len, sorted, 1);
+    tree->his = his;
+    tree->los = los;
+    tree->len = len;
+    return 0;
+}
+
+void interval_tree_free(struct interval_tree *tree) {
+    free((void *)tree->his);
+    free((void *)tree->los);
+}
+
+// whether id is in one of the intervals of the tree, checking every one
+int is_fresh_scan(const struct interval_tree *tree, long id) {
+    const long *los = tree->los + 1;
+    const long *his = tree->his + 1;
+    size_t i = 0;
+    int fresh = 0;
+
+#ifdef HAVE_LONG_VEC_COMPARE
+    // compare VEC_LONGS intervals at once, each lane is -1 on a match
+    long_vec_unaligned found = {0};
+    for (; i + VEC_LONGS <= tree->len; i += VEC_LONGS) {
+        found |= (LOAD_LONGS(los + i) <= id) & (LOAD_LONGS(his + i) >= id);
+    }
+
+    for (int lane = 0; lane < VEC_LONGS; lane++) {
+        fresh |= found[lane] != 0;
+    }
+#endif
+    for (; i < tree->len; i++) {
+        fresh |= (los[i] <= id) & (id <= his[i]);
+    }
+
+    return fresh;
+}
+
+// whether id is in one of the intervals of the tree
+int is_fresh(const struct interval_tree *tree, long id) {
+    if (tree->len <= LINEAR_SCAN_MAX) {
+        return is_fresh_scan(tree, id);
+    }
+
+    // find the first interval ending at or after id without branching on
+    // the comparisons, fetching the nodes four levels down ahead of time
+    size_t k = 1;
+    while (k <= tree->len) {
+        __builtin_prefetch(tree->his + 16 * k);
+        k = 2 * k + (tree->his[k] < id);
+    }
+
+    // undo the right turns taken after the last left turn
+    k >>= __builtin_ffsl(~k);
+    return k != 0 && tree->los[k] <= id;
+}
+
+unsigned long radix_key(long value) {
+    return (unsigned long)value ^ (1UL << 63);
+}
+
+// sort keys in ascending order with an LSD radix sort, using scratch as the
+// second buffer
+void radix_sort(long *keys, long *scratch, size_t n) {
+    size_t counts[RADIX_PASSES][RADIX_BUCKETS] = {{0}};
+    long *src = keys;
+    long *dst = scratch;
+
+    if (n == 0) {
+        return;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned long key = radix_key(keys[i]);
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        size_t *offsets = counts[pass];
+        int shift = pass * RADIX_BITS;
+
+        // skip a pass when every key has the same digit
+        if (offsets[(radix_key(keys[0]) >> shift) & (RADIX_BUCKETS - 1)] == n) {
+            continue;
+        }
+
+        size_t offset = 0;
+        for (int b = 0; b < RADIX_BUCKETS; b++) {
+            size_t count = offsets[b];
+            offsets[b] = offset;
+            offset += count;
+        }
+
+        for (size_t i = 0; i < n; i++) {
+            dst[offsets[(radix_key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+        }
 
+        long *tmp = src;
+        src = dst;
+        dst = tmp;
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(long));
+    }
+}
+
+// count the sorted ids that fall in one of the len sorted, disjoint
+// intervals, walking both lists once
+long count_fresh_sorted(const struct interval *intervals, size_t len, const long *ids, size_t n) {
     long fresh_count = 0;
+    size_t j = 0;
+
+    for (size_t i = 0; i < n; i++) {
+        while (j < len && intervals[j].hi < ids[i]) {
+            j++;
+        }
+        if (j == len) {
+            break;
+        }
+        fresh_count += intervals[j].lo <= ids[i];
+    }
+
+    return fresh_count;
+}
+
+// number of IDs from lo to hi
+uint128 interval_size(long lo, long hi) {
+    // wraps correctly for negative bounds, since hi >= lo
+    return (uint128)hi - (uint128)lo + 1;
+}
+
+// number of IDs in the len sorted, disjoint intervals
+uint128 count_ids(const struct interval *intervals, size_t len) {
+    uint128 total = 0;
+    for (size_t i = 0; i < len; i++) {
+        total += interval_size(intervals[i].lo, intervals[i].hi);
+    }
+    return total;
+}
+
+void print_uint128(FILE *out, uint128 n) {
+    // split into 19 digit chunks that fit in an unsigned long
+    const unsigned long chunk = 10000000000000000000UL;
+    if (n >= chunk) {
+        print_uint128(out, n / chunk);
+        fprintf(out, "%019lu", (unsigned long)(n % chunk));
+    } else {
+        fprintf(out, "%lu", (unsigned long)n);
+    }
+}
+
+void print_result(const struct result *result, const struct config *config) {
+    if (config->count_fresh) {
+        print_uint128(stdout, result->fresh_ids);
+        fputc('\n', stdout);
+    } else {
+        fprintf(stdout, "%ld\n", result->fresh_count);
+    }
+}
+
+// read the range section of input, up to a blank line or the end of input
+int read_ranges(FILE *input, struct ranges *ranges) {
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
 
     while ((linelen = getline(&line, &linecap, input)) != -1) {
-        if (parsing_ranges) {
-            if (linelen == 0 || line[0] == '\n') {
-                parsing_ranges = 0;
-                continue;
-            }
+        if (linelen == 0 || line[0] == '\n') {
+            break;
+        }
+
+        long l_bound, u_bound;
+        if (sscanf(line, "%ld-%ld", &l_bound, &u_bound) != 2) {
+            fprintf(stderr, "bad range line: %s", line);
+            continue;
+        }
+
+        if (ranges_push(ranges, l_bound, u_bound) != 0) {
+            free(line);
+            return -1;
+        }
+    }
+
+    free(line);
+    return 0;
+}
+
+int interval_set_build(struct interval_set *set, const struct ranges *ranges) {
+    size_t len;
+    struct interval *intervals = merge_ranges(ranges, &len);
+    if (!intervals) {
+        return -1;
+    }
+
+    if (interval_tree_init(&set->tree, intervals, len) != 0) {
+        free(intervals);
+        return -1;
+    }
+
+    set->intervals = intervals;
+    set->len = len;
+    return 0;
+}
+
+void interval_set_free(struct interval_set *set) {
+    if (set->map) {
+        munmap(set->map, set->map_size);
+    } else {
+        free((void *)set->intervals);
+        interval_tree_free(&set->tree);
+    }
+}
+
+// write the interval set to an index file that load_index can map
+int build_index(const char *path, const struct interval_set *set) {
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        fprintf(stderr, "error opening file: %s\n", path);
+        return -1;
+    }
+
+    struct index_header header = {
+        .magic = INDEX_MAGIC,
+        .version = INDEX_VERSION,
+        .count = set->len
+    };
+
+    int failed = fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(set->intervals, sizeof(struct interval), set->len, out) != set->len
+        || fwrite(set->tree.his, sizeof(long), set->len + 1, out) != set->len + 1
+        || fwrite(set->tree.los, sizeof(long), set->len + 1, out) != set->len + 1;
+
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "error writing index: %s\n", path);
+        return -1;
+    }
 
+    return 0;
+}
+
+// write an index of the ranges of every file, or of standard input if
+// there are none
+int build_index_from(const char *path, char **filenames, int count) {
+    struct ranges ranges = {0};
+    struct interval_set set = {0};
+
+    for (int i = 0; i < count || (count == 0 && i == 0); i++) {
+        FILE *file_ptr = count ? fopen(filenames[i], "r") : stdin;
+        if (file_ptr == NULL) {
+            fprintf(stderr, "error opening file: %s\n", filenames[i]);
+            ranges_free(&ranges);
+            return -1;
+        }
+
+        int failed = read_ranges(file_ptr, &ranges) != 0;
+        if (file_ptr != stdin) {
+            fclose(file_ptr);
+        }
+        if (failed) {
+            ranges_free(&ranges);
+            return -1;
+        }
+    }
+
+    int failed = interval_set_build(&set, &ranges) != 0 || build_index(path, &set) != 0;
+    ranges_free(&ranges);
+    interval_set_free(&set);
+    return failed ? -1 : 0;
+}
+
+// map an index written by build_index
+int load_index(const char *path, struct interval_set *set) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "error opening file: %s\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct index_header)) {
+        close(fd);
+        fprintf(stderr, "bad index: %s\n", path);
+        return -1;
+    }
+
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "error mapping index: %s\n", path);
+        return -1;
+    }
+
+    const struct index_header *header = map;
+    size_t count = header->count;
+    size_t expected_size = sizeof(struct index_header)
+        + count * sizeof(struct interval)
+        + 2 * (count + 1) * sizeof(long);
+
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+            || header->version != INDEX_VERSION
+            || count > (size_t)st.st_size
+            || (size_t)st.st_size != expected_size) {
+        munmap(map, st.st_size);
+        fprintf(stderr, "bad index: %s\n", path);
+        return -1;
+    }
+
+    set->map = map;
+    set->map_size = st.st_size;
+    set->intervals = (const struct interval *)(header + 1);
+    set->len = count;
+    set->tree.his = (const long *)(set->intervals + count);
+    set->tree.los = set->tree.his + count + 1;
+    set->tree.len = count;
+    return 0;
+}
+
+// count the fresh ingredients in input, one ID per line
+int count_ingredients(FILE *input, const struct config *config, const struct interval_set *set,
+                      long *fresh_count) {
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
+
+    // ingredients held back to be sorted in batch mode
+    long *queries = NULL;
+    size_t queries_len = 0;
+    size_t queries_cap = 0;
+
+    *fresh_count = 0;
+
+    while ((linelen = getline(&line, &linecap, input)) != -1) {
+        long ingredient = strtol(line, NULL, 10);
+
+        if (config->batch) {
             // grow array if needed
-            if (len >= capacity) {
-                capacity *= 2;
-                long** new_arr = realloc(fresh_ing_ranges, capacity * sizeof(long*));
-                if (!new_arr) {
-                    free_arr(fresh_ing_ranges, len);
+            if (queries_len >= queries_cap) {
+                queries_cap = queries_cap ? queries_cap * 2 : 1024;
+                long *new_queries = realloc(queries, queries_cap * sizeof(long));
+                if (!new_queries) {
+                    free(queries);
                     free(line);
                     fprintf(stderr, "realloc failed\n");
                     return -1;
                 }
-                fresh_ing_ranges = new_arr;
+                queries = new_queries;
             }
+            queries[queries_len++] = ingredient;
+        } else if (is_fresh(&set->tree, ingredient)) {
+            (*fresh_count)++;
+        }
+    }
 
-            long l_bound, u_bound;
-            if (sscanf(line, "%ld-%ld", &l_bound, &u_bound) != 2) {
-                fprintf(stderr, "bad range line: %s", line);
-                continue;
-            }
+    free(line);
+
+    if (config->batch && queries_len > 0) {
+        long *scratch = malloc(queries_len * sizeof(long));
+        if (!scratch) {
+            free(queries);
+            fprintf(stderr, "memory allocation failed\n");
+            return -1;
+        }
+
+        radix_sort(queries, scratch, queries_len);
+        *fresh_count = count_fresh_sorted(set->intervals, set->len, queries, queries_len);
+        free(scratch);
+    }
+
+    free(queries);
+    return 0;
+}
+
+struct interval_node *node_new(struct dynamic_set *set, long lo, long hi) {
+    struct interval_node *node = malloc(sizeof(struct interval_node));
+    if (!node) {
+        fprintf(stderr, "memory allocation failed\n");
+        return NULL;
+    }
+
+    // xorshift64
+    set->seed ^= set->seed << 13;
+    set->seed ^= set->seed >> 7;
+    set->seed ^= set->seed << 17;
+
+    node->lo = lo;
+    node->hi = hi;
+    node->priority = set->seed;
+    node->left = NULL;
+    node->right = NULL;
+    return node;
+}
+
+// free every interval of a subtree, adding up how many IDs they held
+void node_free(struct interval_node *node, uint128 *size) {
+    if (node) {
+        *size += interval_size(node->lo, node->hi);
+        node_free(node->left, size);
+        node_free(node->right, size);
+        free(node);
+    }
+}
+
+// split a subtree into the intervals starting before key, or at key too if
+// inclusive, and the rest
+void node_split(struct interval_node *node, long key, int inclusive,
+                struct interval_node **left, struct interval_node **right) {
+    if (!node) {
+        *left = NULL;
+        *right = NULL;
+    } else if (node->lo < key || (inclusive && node->lo == key)) {
+        node_split(node->right, key, inclusive, &node->right, right);
+        *left = node;
+    } else {
+        node_split(node->left, key, inclusive, left, &node->left);
+        *right = node;
+    }
+}
+
+// join two subtrees where every interval of left starts before right's
+struct interval_node *node_merge(struct interval_node *left, struct interval_node *right) {
+    if (!left) {
+        return right;
+    }
+    if (!right) {
+        return left;
+    }
+
+    if (left->priority > right->priority) {
+        left->right = node_merge(left->right, right);
+        return left;
+    }
+    right->left = node_merge(left, right->left);
+    return right;
+}
+
+struct interval_node *node_last(struct interval_node *node) {
+    while (node && node->right) {
+        node = node->right;
+    }
+    return node;
+}
+
+// add lo-hi to the set, merging it with the intervals it overlaps or touches
+int dynamic_add(struct dynamic_set *set, long lo, long hi) {
+    if (lo > hi) {
+        return 0;
+    }
+
+    struct interval_node *node = node_new(set, lo, hi);
+    if (!node) {
+        return -1;
+    }
+
+    struct interval_node *left, *middle, *right, *prev;
+    uint128 absorbed = 0;
+
+    node_split(set->root, lo, 0, &left, &right);
+
+    // an interval starting before lo absorbs the new one if it reaches lo - 1
+    prev = node_last(left);
+    if (prev && prev->hi >= lo - 1) {
+        node->lo = prev->lo;
+        if (prev->hi > node->hi) {
+            node->hi = prev->hi;
+        }
+        node_split(left, prev->lo, 0, &left, &prev);
+        node_free(prev, &absorbed);
+    }
+
+    // every interval starting up to hi + 1 is absorbed
+    if (hi == LONG_MAX) {
+        middle = right;
+        right = NULL;
+    } else {
+        node_split(right, hi + 1, 1, &middle, &right);
+    }
+
+    struct interval_node *last = node_last(middle);
+    if (last && last->hi > node->hi) {
+        node->hi = last->hi;
+    }
+    node_free(middle, &absorbed);
+
+    set->covered += interval_size(node->lo, node->hi) - absorbed;
+    set->root = node_merge(node_merge(left, node), right);
+    return 0;
+}
+
+// remove lo-hi from the set, trimming or splitting the intervals it overlaps
+int dynamic_remove(struct dynamic_set *set, long lo, long hi) {
+    if (lo > hi) {
+        return 0;
+    }
+
+    // what is left of an interval reaching past hi, allocated up front so
+    // that running out of memory leaves the set as it was
+    struct interval_node *tail = node_new(set, 0, 0);
+    if (!tail) {
+        return -1;
+    }
+    int tail_used = 0;
+
+    struct interval_node *left, *middle, *right;
+    uint128 removed = 0;
+
+    node_split(set->root, lo, 0, &left, &right);
+
+    struct interval_node *prev = node_last(left);
+    if (prev && prev->hi >= lo) {
+        if (prev->hi > hi) {
+            tail->lo = hi + 1;
+            tail->hi = prev->hi;
+            tail_used = 1;
+        }
+        removed += interval_size(lo, prev->hi > hi ? hi : prev->hi);
+        prev->hi = lo - 1;
+    }
+
+    // every interval starting up to hi loses its IDs up to hi
+    if (hi == LONG_MAX) {
+        middle = right;
+        right = NULL;
+    } else {
+        node_split(right, hi, 1, &middle, &right);
+    }
+
+    struct interval_node *last = node_last(middle);
+    if (last && last->hi > hi) {
+        tail->lo = hi + 1;
+        tail->hi = last->hi;
+        tail_used = 1;
+        removed -= interval_size(tail->lo, tail->hi);
+    }
+    node_free(middle, &removed);
+
+    if (tail_used) {
+        right = node_merge(tail, right);
+    } else {
+        free(tail);
+    }
+
+    set->covered -= removed;
+    set->root = node_merge(left, right);
+    return 0;
+}
 
-            long* arr = malloc(2*sizeof(long));
-            arr[0] = l_bound;
-            arr[1] = u_bound;
-            fresh_ing_ranges[len] = arr;
-            len++;
+int dynamic_contains(const struct dynamic_set *set, long id) {
+    const struct interval_node *node = set->root;
+    while (node) {
+        if (id < node->lo) {
+            node = node->left;
+        } else if (id > node->hi) {
+            node = node->right;
         } else {
-            long ingredient = strtol(line, NULL, 10);
-            for (size_t i = 0; i < len; i++) {
-                long* range = fresh_ing_ranges[i];
-                if (ingredient >= range[0] && ingredient <= range[1]) {
-                    fresh_count++;
-                    break;
-                }
-            }
+            return 1;
         }
     }
+    return 0;
+}
 
+// Apply the operations in input to a set that starts empty, counting the
+// queried IDs that were fresh at the time and the IDs covered at the end.
+int run_ops(FILE *input, struct result *result) {
+    struct dynamic_set set = { .seed = 0x9e3779b97f4a7c15UL };
+
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
+    int failed = 0;
+
+    result->fresh_count = 0;
+
+    while (!failed && (linelen = getline(&line, &linecap, input)) != -1) {
+        long l_bound, u_bound, id;
+        char *end;
+
+        if (strncmp(line, "add ", 4) == 0 && sscanf(line + 4, "%ld-%ld", &l_bound, &u_bound) == 2) {
+            failed = dynamic_add(&set, l_bound, u_bound) != 0;
+        } else if (strncmp(line, "remove ", 7) == 0 && sscanf(line + 7, "%ld-%ld", &l_bound, &u_bound) == 2) {
+            failed = dynamic_remove(&set, l_bound, u_bound) != 0;
+        } else if (strncmp(line, "query ", 6) == 0 && (id = strtol(line + 6, &end, 10), end != line + 6)) {
+            result->fresh_count += dynamic_contains(&set, id);
+        } else if (linelen > 0 && line[0] != '\n') {
+            fprintf(stderr, "bad operation line: %s", line);
+        }
+    }
+
+    result->fresh_ids = set.covered;
+
+    uint128 unused = 0;
+    node_free(set.root, &unused);
     free(line);
-    free_arr(fresh_ing_ranges, len);
-    return fresh_count;
+    return failed ? -1 : 0;
+}
+
+// answer for one FILE, using the ranges in index if it is not NULL and the
+// ones at the start of input otherwise
+int solve(FILE *input, const struct config *config, const struct interval_set *index,
+          struct result *result) {
+    struct interval_set built = {0};
+    const struct interval_set *set = index;
+
+    if (config->ops) {
+        return run_ops(input, result);
+    }
+
+    if (!index) {
+        struct ranges ranges = {0};
+        if (read_ranges(input, &ranges) != 0 || interval_set_build(&built, &ranges) != 0) {
+            ranges_free(&ranges);
+            return -1;
+        }
+        ranges_free(&ranges);
+        set = &built;
+    }
+
+    result->fresh_count = 0;
+    result->fresh_ids = 0;
+
+    // the ingredients are not needed to count the fresh IDs
+    if (config->count_fresh) {
+        result->fresh_ids = count_ids(set->intervals, set->len);
+    } else if (count_ingredients(input, config, set, &result->fresh_count) != 0) {
+        interval_set_free(&built);
+        return -1;
+    }
+
+    interval_set_free(&built);
+    return 0;
 }
 
 int main(int argc, char **argv) {
     const char *prog = argv[0];
 
     static struct option long_opts[] = {
+        {"count-fresh", no_argument, 0, 'c'},
+        {"batch", no_argument, 0, 'b'},
+        {"index", required_argument, 0, 'i'},
+        {"build-index", required_argument, 0, 'I'},
+        {"ops", no_argument, 0, 'o'},
         {"help", no_argument, 0, 'h'},
-        {"version", no_argument, 0, 'V'}
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
     };
 
     int opt;
     int opt_index = 0;
+    struct config config = {0};
+    const char *index_path = NULL;
+    const char *build_path = NULL;
 
-    const char *short_opts = "hV";
+    const char *short_opts = "cbi:I:ohV";
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
         switch (opt) {
+            case 'c':
+                config.count_fresh = 1;
+                break;
+            case 'b':
+                config.batch = 1;
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            case 'I':
+                build_path = optarg;
+                break;
+            case 'o':
+                config.ops = 1;
+                break;
             case 'h':
                 usage(stdout, prog);
                 return EXIT_SUCCESS;
@@ -135,15 +937,34 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (config.ops && (index_path || build_path || config.batch)) {
+        fprintf(stderr, "--ops cannot be combined with --index, --build-index or --batch\n");
+        return EXIT_FAILURE;
+    }
+
+    if (build_path) {
+        return build_index_from(build_path, argv + optind, argc - optind) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    struct interval_set index = {0};
+    struct interval_set *index_ptr = NULL;
+    if (index_path) {
+        if (load_index(index_path, &index) != 0) {
+            return EXIT_FAILURE;
+        }
+        index_ptr = &index;
+    }
+
+    struct result result;
+
     if (optind == argc) {
-        long answer;
-        if ((answer = solve(stdin)) == -1) {
+        if (solve(stdin, &config, index_ptr, &result) == -1) {
+            interval_set_free(&index);
             return EXIT_FAILURE;
         }
-        fprintf(stdout, "%ld\n", answer);
+        print_result(&result, &config);
     } else {
         FILE *file_ptr;
-        long answer;
 
         for (int i = optind; i < argc; i++) {
             const char *filename = argv[i];
@@ -151,18 +972,21 @@ int main(int argc, char **argv) {
             file_ptr = fopen(filename, "r");
             if (file_ptr == NULL) {
                 fprintf(stderr, "error opening file: %s\n", filename);
+                interval_set_free(&index);
                 return EXIT_FAILURE;
             }
 
-            if ((answer = solve(file_ptr)) == -1) {
+            if (solve(file_ptr, &config, index_ptr, &result) == -1) {
                 fclose(file_ptr);
+                interval_set_free(&index);
                 return EXIT_FAILURE;
             }
 
-            fprintf(stdout, "%ld\n", answer);
+            print_result(&result, &config);
             fclose(file_ptr);
         }
     }
 
+    interval_set_free(&index);
     return EXIT_SUCCESS;
 }
@@ -14,12 +14,20 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <getopt.h>
-#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// exact decimal total, digits[0] being the least significant digit
+struct decimal {
+    unsigned char *digits;
+    size_t len;
+    size_t capacity;
+};
+
 void usage(FILE *out, const char *prog) {
     fprintf(out,
         "Usage: %s [OPTION]... [FILE]...\n"
@@ -36,69 +44,117 @@ void usage(FILE *out, const char *prog) {
     );
 }
 
-long long get_max_joltage(char* bank, int num_batteries) {
-    int battery_pos[num_batteries];
-    size_t bank_len = strlen(bank);
-
-    int curr_battery = 0;
-
-    while (curr_battery < num_batteries) {
-        int largest_index = 0;
-        int largest_joltage = 0;
-
-        // next loc after previously selected battery
-        int first_pos_to_check = curr_battery == 0 ? 0 : battery_pos[curr_battery - 1] + 1;
-        int last_pos_to_check = bank_len - num_batteries + curr_battery;
+// Write the largest joltage made of num_batteries batteries of the bank to
+// joltage, one digit per battery. The digits chosen so far form a stack
+// that stays non-increasing: a larger digit pops smaller ones while enough
+// batteries remain after it to fill the rest, so each battery is pushed and
+// popped at most once.
+void get_max_joltage(const char *bank, size_t bank_len, char *joltage, int num_batteries) {
+    size_t skippable = bank_len - num_batteries;
+    size_t top = 0;
+
+    for (size_t i = 0; i < bank_len; i++) {
+        char battery = bank[i];
+
+        while (top > 0 && skippable > 0 && joltage[top - 1] < battery) {
+            top--;
+            skippable--;
+        }
 
-        for (int i = first_pos_to_check; i <= last_pos_to_check; i++) {
-            int joltage = bank[i] - '0';
+        if (top < (size_t)num_batteries) {
+            joltage[top++] = battery;
+        } else {
+            skippable--;
+        }
+    }
+}
 
-            if (joltage > largest_joltage) {
-                largest_joltage = joltage;
-                largest_index = i;
-            }
+// add a number given as len decimal digits, most significant first
+int decimal_add(struct decimal *total, const char *digits, size_t len) {
+    // grow array if needed, leaving room for a carry past the longer of the
+    // total and the number
+    size_t needed = (len > total->len ? len : total->len) + 1;
+    if (needed > total->capacity) {
+        size_t capacity = total->capacity ? total->capacity : 32;
+        while (capacity < needed) {
+            capacity *= 2;
         }
+        unsigned char *new_digits = realloc(total->digits, capacity);
+        if (!new_digits) {
+            fprintf(stderr, "realloc failed\n");
+            return -1;
+        }
+        memset(new_digits + total->capacity, 0, capacity - total->capacity);
+        total->digits = new_digits;
+        total->capacity = capacity;
+    }
 
-        battery_pos[curr_battery] = largest_index;
-        curr_battery++;
+    int carry = 0;
+    size_t i = 0;
+    for (; i < len || carry; i++) {
+        int digit = total->digits[i] + carry + (i < len ? digits[len - 1 - i] - '0' : 0);
+        carry = digit >= 10;
+        total->digits[i] = digit - carry * 10;
     }
 
+    if (i > total->len) {
+        total->len = i;
+    }
+    return 0;
+}
+
+void decimal_print(FILE *out, const struct decimal *total) {
+    size_t i = total->len;
 
-    long long max_joltage = 0;
-    for (int i = 0; i < num_batteries; i++) {
-        int battery_val = bank[battery_pos[num_batteries - i - 1]] - '0';
-        max_joltage += battery_val * pow(10, i);
+    // skip leading zeros
+    while (i > 1 && total->digits[i - 1] == 0) {
+        i--;
     }
 
-    return max_joltage;
+    if (i == 0) {
+        fputc('0', out);
+    }
+    while (i-- > 0) {
+        fputc('0' + total->digits[i], out);
+    }
+    fputc('\n', out);
 }
 
-long long solve(FILE *input, int num_batteries) {
+int solve(FILE *input, int num_batteries, struct decimal *total) {
     char* line = NULL;
     size_t linecap = 0;
-    int linelen;
+    ssize_t linelen;
 
-    long long total_joltage = 0;
+    char *joltage = malloc(num_batteries);
+    if (!joltage) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
 
     while ((linelen = getline(&line, &linecap, input)) != -1) {
         if (linelen == 0 || line[0] == '\n') {
             continue;
         }
 
-        // terminate strings at first non-numerical character (\n causes bugs)
-        int i = 0;
-        while (line[i] - '0' >= 0 && line[i] - '0' <= 9) {
-            i++;
+        // the bank ends at the first non-numerical character
+        size_t bank_len = strspn(line, "0123456789");
+        if (bank_len < (size_t)num_batteries) {
+            fprintf(stderr, "bank has fewer than %d batteries: %s", num_batteries, line);
+            continue;
         }
-        line[i] = '\0';
 
-        long long max_joltage = get_max_joltage(line, num_batteries);
-        total_joltage += max_joltage;
+        get_max_joltage(line, bank_len, joltage, num_batteries);
+        if (decimal_add(total, joltage, num_batteries) != 0) {
+            free(joltage);
+            free(line);
+            return -1;
+        }
     }
 
+    free(joltage);
     free(line);
 
-    return total_joltage;
+    return 0;
 }
 
 int main(int argc, char **argv) {
@@ -107,7 +163,8 @@ int main(int argc, char **argv) {
     static struct option long_opts[] = {
         {"number", required_argument, 0, 'n'},
         {"help", no_argument, 0, 'h'},
-        {"version", no_argument, 0, 'V'}
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
     };
 
     int opt;
@@ -120,6 +177,10 @@ int main(int argc, char **argv) {
         switch (opt) {
             case 'n':
                 num_batteries = atoi(optarg);
+                if (num_batteries < 1) {
+                    fprintf(stderr, "invalid number of batteries: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
                 break;
             case 'h':
                 usage(stdout, prog);
@@ -134,14 +195,15 @@ int main(int argc, char **argv) {
     }
 
     if (optind == argc) {
-        long long answer;
-        if ((answer = solve(stdin, num_batteries)) == -1) {
+        struct decimal total = {0};
+        if (solve(stdin, num_batteries, &total) == -1) {
+            free(total.digits);
             return EXIT_FAILURE;
         }
-        fprintf(stdout, "%lld\n", answer);
+        decimal_print(stdout, &total);
+        free(total.digits);
     } else {
         FILE *file_ptr;
-        long long answer;
 
         for (int i = optind; i < argc; i++) {
             const char *filename = argv[i];
@@ -152,12 +214,15 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
 
-            if ((answer = solve(file_ptr, num_batteries)) == -1) {
+            struct decimal total = {0};
+            if (solve(file_ptr, num_batteries, &total) == -1) {
+                free(total.digits);
                 fclose(file_ptr);
                 return EXIT_FAILURE;
             }
 
-            fprintf(stdout, "%lld\n", answer);
+            decimal_print(stdout, &total);
+            free(total.digits);
             fclose(file_ptr);
         }
     }
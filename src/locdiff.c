@@ -14,9 +14,109 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+__extension__ typedef __int128 int128;
+__extension__ typedef unsigned __int128 uint128;
+
+// bits sorted per radix pass, 8 passes cover a 64-bit key
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES (64 / RADIX_BITS)
+
+// metrics selected on the command line
+#define METRIC_DISTANCE 1
+#define METRIC_SIMILARITY 2
+
+// smallest chunk sorted in memory by --memory-limit, in location pairs
+#define MIN_CHUNK_PAIRS 1024
+// smallest read buffer per sorted run during the merge, in IDs
+#define MIN_RUN_BUFFER 512
+// smallest --memory-limit, one chunk of MIN_CHUNK_PAIRS pairs and their scratch
+#define MIN_MEMORY_LIMIT (MIN_CHUNK_PAIRS * 4 * sizeof(long))
+
+// splitter candidates sampled per thread by the parallel sort
+#define SAMPLES_PER_JOB 64
+// columns shorter than this per thread are sorted on one thread
+#define MIN_PARALLEL_PAIRS 16384
+
+struct config {
+    int metrics;
+    int hash_count;
+    size_t memory_limit;
+    int jobs;
+};
+
+struct scores {
+    uint128 distance;
+    int128 similarity;
+};
+
+// state shared by the threads of a parallel sample sort of both columns.
+// Keys fall into 2 * jobs - 1 buckets: one between each pair of splitters and
+// one for keys equal to each splitter, so duplicates cannot pile up in a
+// single bucket that one thread has to sort alone.
+struct parallel_sort {
+    int jobs;
+    size_t n;
+    size_t num_buckets;
+    long *columns[2];
+    long *scratch[2];
+    long *splitters[2];
+    size_t *offsets[2];
+};
+
+struct sort_task {
+    pthread_t thread;
+    struct parallel_sort *sort;
+    int id;
+    uint128 partial_distance;
+};
+
+// a sorted run spilled to a temporary file, read back through a small buffer
+struct run_cursor {
+    off_t offset;
+    size_t remaining;
+    long *buffer;
+    size_t pos;
+    size_t len;
+};
+
+// k-way merge of the sorted runs of one column, ordered by a binary min-heap
+struct run_merger {
+    int fd;
+    struct run_cursor *cursors;
+    size_t *heap;
+    size_t heap_len;
+    long *buffers;
+    size_t buffer_len;
+};
+
+// sorted runs of one column written to a temporary file
+struct run_file {
+    FILE *file;
+    off_t *offsets;
+    size_t *lengths;
+    size_t num_runs;
+    size_t capacity;
+};
+
+// open-addressing table counting how often each location ID appears
+struct count_table {
+    long *keys;
+    size_t *counts;
+    size_t mask;
+    int shift;
+};
 
 void usage(FILE *out, const char *prog) {
     fprintf(out, 
@@ -25,15 +125,23 @@ void usage(FILE *out, const char *prog) {
         "Calculate the total distance between two lists of location IDs contained in each FILE.\n"
         "\n"
         "With no FILE, read standard input.\n"
+        "When both metrics are requested, the distance is printed before the similarity score.\n"
         "\n"
         "Options:\n"
-        "   -h, --help      Display this help and exit\n"
-        "   -V, --version   Display version information and exit\n",
+        "   -d, --distance    Report the total distance (default unless --similarity is given)\n"
+        "   -s, --similarity  Report the similarity score\n"
+        "   -H, --hash        Count right IDs in a hash table for the similarity score instead of sorting\n"
+        "   -j, --jobs=N      Sort and sum on N threads (default: 1)\n"
+        "   -m, --memory-limit=SIZE\n"
+        "                     Sort in chunks of at most SIZE bytes spilled to temporary files,\n"
+        "                     SIZE may end in K, M or G and must be at least 32K\n"
+        "   -h, --help        Display this help and exit\n"
+        "   -V, --version     Display version information and exit\n",
         prog
     );
 }
 
-int read_input(FILE *input, long **left_list, long **right_list, size_t *len) {
+int read_input_stream(FILE *input, long **left_list, long **right_list, size_t *len) {
     size_t capacity = 16;
     size_t length = 0;
 
@@ -113,50 +221,1157 @@ int read_input(FILE *input, long **left_list, long **right_list, size_t *len) {
     return 0;
 }
 
-int sort_asc(const void *a, const void *b) {
-    return (*(long *)a - *(long *)b);
+// parse a decimal number with an optional sign at *pos, skipping leading
+// blanks. Returns 0 and advances *pos past the number, or -1 if there is none.
+int parse_long(const char **pos, const char *end, long *out) {
+    const char *p = *pos;
+
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+
+    int negative = 0;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+
+    const char *digits = p;
+    unsigned long value = 0;
+    while (p < end && (unsigned)(*p - '0') <= 9) {
+        unsigned long digit = *p - '0';
+        if (value > (9223372036854775808UL - digit) / 10) {
+            return -1;
+        }
+        value = value * 10 + digit;
+        p++;
+    }
+
+    if (p == digits || (!negative && value > 9223372036854775807UL)) {
+        return -1;
+    }
+
+    *out = negative ? (long)(0 - value) : (long)value;
+    *pos = p;
+    return 0;
+}
+
+// parse a regular file in place through a read-only mapping, sizing both
+// columns from a newline count up front
+int read_input_mapped(int fd, size_t size, long **left_list, long **right_list, size_t *len) {
+    char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "mmap failed\n");
+        return -1;
+    }
+    posix_madvise(data, size, POSIX_MADV_SEQUENTIAL);
+
+    const char *end = data + size;
+    size_t capacity = 1;
+    for (const char *p = data; (p = memchr(p, '\n', end - p)) != NULL; p++) {
+        capacity++;
+    }
+
+    long *left = malloc(capacity * sizeof(long));
+    long *right = malloc(capacity * sizeof(long));
+    if (!left || !right) {
+        free(left);
+        free(right);
+        munmap(data, size);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    size_t length = 0;
+    size_t line_num = 0;
+    const char *p = data;
+
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (eol == NULL) {
+            eol = end;
+        }
+        line_num++;
+
+        // skip blank lines
+        const char *q = p;
+        while (q < eol && (*q == ' ' || *q == '\t' || *q == '\r')) {
+            q++;
+        }
+        if (q == eol) {
+            p = eol + 1;
+            continue;
+        }
+
+        if (parse_long(&q, eol, &left[length]) != 0) {
+            fprintf(stderr, "failed to parse first number on line %zu\n", line_num);
+            goto fail;
+        }
+        if (parse_long(&q, eol, &right[length]) != 0) {
+            fprintf(stderr, "failed to parse second number on line %zu\n", line_num);
+            goto fail;
+        }
+
+        length++;
+        p = eol + 1;
+    }
+
+    munmap(data, size);
+
+    *left_list = left;
+    *right_list = right;
+    *len = length;
+    return 0;
+
+fail:
+    free(left);
+    free(right);
+    munmap(data, size);
+    return -1;
+}
+
+int read_input(FILE *input, long **left_list, long **right_list, size_t *len) {
+    struct stat st;
+
+    // map regular files, pipes and terminals are read line by line
+    if (fstat(fileno(input), &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        return read_input_mapped(fileno(input), st.st_size, left_list, right_list, len);
+    }
+
+    return read_input_stream(input, left_list, right_list, len);
+}
+
+// flip the sign bit so signed keys order correctly as unsigned
+unsigned long radix_key(long value) {
+    return (unsigned long)value ^ (1UL << 63);
+}
+
+// count the digits of every pass in a single read of the keys
+void radix_histogram(const long *keys, size_t n, size_t counts[RADIX_PASSES][RADIX_BUCKETS]) {
+    memset(counts, 0, RADIX_PASSES * RADIX_BUCKETS * sizeof(size_t));
+
+    for (size_t i = 0; i < n; i++) {
+        unsigned long key = radix_key(keys[i]);
+        for (int pass = 0; pass < RADIX_PASSES; pass++) {
+            counts[pass][(key >> (pass * RADIX_BITS)) & (RADIX_BUCKETS - 1)]++;
+        }
+    }
+}
+
+// turn the counts of one pass into starting offsets, returns 0 if every key
+// has the same digit and the pass would not move anything
+int radix_offsets(size_t counts[RADIX_BUCKETS], size_t n) {
+    size_t offset = 0;
+
+    for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+        if (counts[bucket] == n) {
+            return 0;
+        }
+        size_t count = counts[bucket];
+        counts[bucket] = offset;
+        offset += count;
+    }
+
+    return 1;
+}
+
+void radix_scatter(const long *src, long *dst, size_t n, size_t offsets[RADIX_BUCKETS], int pass) {
+    int shift = pass * RADIX_BITS;
+    for (size_t i = 0; i < n; i++) {
+        dst[offsets[(radix_key(src[i]) >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+    }
+}
+
+// sort both location columns in ascending order with an LSD radix sort,
+// running the passes of both columns side by side
+int radix_sort_pair(long *left, long *right, size_t n) {
+    size_t (*left_counts)[RADIX_BUCKETS] = malloc(2 * RADIX_PASSES * sizeof(*left_counts));
+    long *scratch = malloc(2 * n * sizeof(long));
+    if (!left_counts || !scratch) {
+        free(left_counts);
+        free(scratch);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+    size_t (*right_counts)[RADIX_BUCKETS] = left_counts + RADIX_PASSES;
+
+    radix_histogram(left, n, left_counts);
+    radix_histogram(right, n, right_counts);
+
+    long *left_src = left, *left_dst = scratch;
+    long *right_src = right, *right_dst = scratch + n;
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        if (radix_offsets(left_counts[pass], n)) {
+            radix_scatter(left_src, left_dst, n, left_counts[pass], pass);
+            long *tmp = left_src;
+            left_src = left_dst;
+            left_dst = tmp;
+        }
+
+        if (radix_offsets(right_counts[pass], n)) {
+            radix_scatter(right_src, right_dst, n, right_counts[pass], pass);
+            long *tmp = right_src;
+            right_src = right_dst;
+            right_dst = tmp;
+        }
+    }
+
+    // an odd number of passes leaves the result in the scratch buffer
+    if (left_src != left) {
+        memcpy(left, left_src, n * sizeof(long));
+    }
+    if (right_src != right) {
+        memcpy(right, right_src, n * sizeof(long));
+    }
+
+    free(scratch);
+    free(left_counts);
+    return 0;
+}
+
+// sort one column with an LSD radix sort, using scratch as the second buffer
+void radix_sort(long *keys, long *scratch, size_t n) {
+    size_t counts[RADIX_PASSES][RADIX_BUCKETS];
+    long *src = keys;
+    long *dst = scratch;
+
+    radix_histogram(keys, n, counts);
+
+    for (int pass = 0; pass < RADIX_PASSES; pass++) {
+        if (radix_offsets(counts[pass], n)) {
+            radix_scatter(src, dst, n, counts[pass], pass);
+            long *tmp = src;
+            src = dst;
+            dst = tmp;
+        }
+    }
+
+    if (src != keys) {
+        memcpy(keys, src, n * sizeof(long));
+    }
+}
+
+// absolute difference of two IDs, exact for any pair of longs
+unsigned long distance_between(long a, long b) {
+    return a > b ? (unsigned long)a - (unsigned long)b : (unsigned long)b - (unsigned long)a;
+}
+
+int compare_longs(const void *a, const void *b) {
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+// run fn on jobs tasks, the first of them on the calling thread
+int run_tasks(struct sort_task *tasks, int jobs, void *(*fn)(void *)) {
+    int started = 1;
+    int failed = 0;
+
+    for (; started < jobs; started++) {
+        if (pthread_create(&tasks[started].thread, NULL, fn, &tasks[started]) != 0) {
+            fprintf(stderr, "failed to start thread\n");
+            failed = 1;
+            break;
+        }
+    }
+
+    fn(&tasks[0]);
+
+    for (int i = 1; i < started; i++) {
+        pthread_join(tasks[i].thread, NULL);
+    }
+
+    return failed ? -1 : 0;
+}
+
+size_t bucket_of(long key, const long *splitters, size_t num_splitters) {
+    size_t lo = 0;
+    size_t hi = num_splitters;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (splitters[mid] < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo < num_splitters && splitters[lo] == key) {
+        return 2 * lo + 1;
+    }
+    return 2 * lo;
+}
+
+// slice of [0, n) handled by task id
+void task_slice(const struct sort_task *task, size_t *start, size_t *end) {
+    size_t n = task->sort->n;
+    *start = n / task->sort->jobs * task->id;
+    *end = task->id == task->sort->jobs - 1 ? n : *start + n / task->sort->jobs;
+}
+
+// count how many keys of this task's slice land in each bucket
+void *count_buckets(void *arg) {
+    struct sort_task *task = arg;
+    struct parallel_sort *sort = task->sort;
+    size_t start, end;
+    task_slice(task, &start, &end);
+
+    for (int c = 0; c < 2; c++) {
+        size_t *counts = sort->offsets[c] + task->id * sort->num_buckets;
+        for (size_t i = start; i < end; i++) {
+            counts[bucket_of(sort->columns[c][i], sort->splitters[c], sort->jobs - 1)]++;
+        }
+    }
+
+    return NULL;
+}
+
+// move the keys of this task's slice into their buckets in scratch
+void *scatter_buckets(void *arg) {
+    struct sort_task *task = arg;
+    struct parallel_sort *sort = task->sort;
+    size_t start, end;
+    task_slice(task, &start, &end);
+
+    for (int c = 0; c < 2; c++) {
+        size_t *offsets = sort->offsets[c] + task->id * sort->num_buckets;
+        for (size_t i = start; i < end; i++) {
+            long key = sort->columns[c][i];
+            sort->scratch[c][offsets[bucket_of(key, sort->splitters[c], sort->jobs - 1)]++] = key;
+        }
+    }
+
+    return NULL;
+}
+
+// sort the bucket between splitters id - 1 and id and copy it, along with the
+// bucket of keys equal to splitter id - 1, back into the column
+void *sort_buckets(void *arg) {
+    struct sort_task *task = arg;
+    struct parallel_sort *sort = task->sort;
+
+    for (int c = 0; c < 2; c++) {
+        // after scattering, the last task's offsets mark the end of each bucket
+        const size_t *last = sort->offsets[c] + (sort->jobs - 1) * sort->num_buckets;
+        size_t bucket = 2 * task->id;
+        size_t end = last[bucket];
+        size_t start = bucket == 0 ? 0 : last[bucket - 1];
+
+        radix_sort(sort->scratch[c] + start, sort->columns[c] + start, end - start);
+        memcpy(sort->columns[c] + start, sort->scratch[c] + start, (end - start) * sizeof(long));
+
+        if (bucket > 0) {
+            size_t equal_start = bucket == 1 ? 0 : last[bucket - 2];
+            memcpy(sort->columns[c] + equal_start, sort->scratch[c] + equal_start,
+                (start - equal_start) * sizeof(long));
+        }
+    }
+
+    return NULL;
+}
+
+void *sum_distances(void *arg) {
+    struct sort_task *task = arg;
+    struct parallel_sort *sort = task->sort;
+    const long *left = sort->columns[0];
+    const long *right = sort->columns[1];
+    uint128 total_distance = 0;
+    size_t start, end;
+    task_slice(task, &start, &end);
+
+    for (size_t i = start; i < end; i++) {
+        total_distance += distance_between(left[i], right[i]);
+    }
+
+    task->partial_distance = total_distance;
+    return NULL;
+}
+
+// pick jobs - 1 splitters for a column from an evenly spaced sample
+void choose_splitters(const long *keys, size_t n, long *sample, size_t sample_len,
+                      long *splitters, int jobs) {
+    for (size_t i = 0; i < sample_len; i++) {
+        sample[i] = keys[i * (n / sample_len)];
+    }
+    qsort(sample, sample_len, sizeof(long), compare_longs);
+
+    for (int i = 1; i < jobs; i++) {
+        splitters[i - 1] = sample[i * sample_len / jobs];
+    }
+}
+
+// sort both columns on jobs threads with a sample sort, where every thread
+// handles its share of both columns in each phase
+int parallel_sort_pair(long *left, long *right, size_t n, int jobs) {
+    if (jobs < 2 || n / jobs < MIN_PARALLEL_PAIRS) {
+        return radix_sort_pair(left, right, n);
+    }
+
+    struct parallel_sort sort = {
+        .jobs = jobs,
+        .n = n,
+        .num_buckets = 2 * jobs - 1,
+        .columns = { left, right }
+    };
+    size_t sample_len = (size_t)jobs * SAMPLES_PER_JOB;
+
+    long *scratch = malloc(2 * n * sizeof(long));
+    long *splitters = malloc(2 * (jobs - 1) * sizeof(long));
+    long *sample = malloc(sample_len * sizeof(long));
+    size_t *offsets = calloc(2 * jobs * sort.num_buckets, sizeof(size_t));
+    struct sort_task *tasks = calloc(jobs, sizeof(struct sort_task));
+    int status = -1;
+
+    if (!scratch || !splitters || !sample || !offsets || !tasks) {
+        fprintf(stderr, "memory allocation failed\n");
+        goto done;
+    }
+
+    for (int c = 0; c < 2; c++) {
+        sort.scratch[c] = scratch + c * n;
+        sort.splitters[c] = splitters + c * (jobs - 1);
+        sort.offsets[c] = offsets + c * jobs * sort.num_buckets;
+        choose_splitters(sort.columns[c], n, sample, sample_len, sort.splitters[c], jobs);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        tasks[i].sort = &sort;
+        tasks[i].id = i;
+    }
+
+    if (run_tasks(tasks, jobs, count_buckets) != 0) {
+        goto done;
+    }
+
+    // turn the counts into the offset where each task writes each bucket,
+    // buckets in order and tasks in order within a bucket
+    for (int c = 0; c < 2; c++) {
+        size_t offset = 0;
+        for (size_t b = 0; b < sort.num_buckets; b++) {
+            for (int t = 0; t < jobs; t++) {
+                size_t *count = &sort.offsets[c][t * sort.num_buckets + b];
+                size_t bucket_count = *count;
+                *count = offset;
+                offset += bucket_count;
+            }
+        }
+    }
+
+    if (run_tasks(tasks, jobs, scatter_buckets) != 0 || run_tasks(tasks, jobs, sort_buckets) != 0) {
+        goto done;
+    }
+
+    status = 0;
+
+done:
+    free(scratch);
+    free(splitters);
+    free(sample);
+    free(offsets);
+    free(tasks);
+    return status;
+}
+
+// sum of |left[i] - right[i]| over sorted columns, split across jobs threads
+int parallel_distance(const long *left, const long *right, size_t n, int jobs, uint128 *out) {
+    if (jobs < 2 || n / jobs < MIN_PARALLEL_PAIRS) {
+        uint128 total_distance = 0;
+        for (size_t i = 0; i < n; i++) {
+            total_distance += distance_between(left[i], right[i]);
+        }
+        *out = total_distance;
+        return 0;
+    }
+
+    struct parallel_sort sort = {
+        .jobs = jobs,
+        .n = n,
+        .columns = { (long *)left, (long *)right }
+    };
+    struct sort_task *tasks = calloc(jobs, sizeof(struct sort_task));
+    if (!tasks) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        tasks[i].sort = &sort;
+        tasks[i].id = i;
+    }
+
+    if (run_tasks(tasks, jobs, sum_distances) != 0) {
+        free(tasks);
+        return -1;
+    }
+
+    // reduce in task order
+    uint128 total_distance = 0;
+    for (int i = 0; i < jobs; i++) {
+        total_distance += tasks[i].partial_distance;
+    }
+
+    free(tasks);
+    *out = total_distance;
+    return 0;
+}
+
+// sum of each left ID times the number of times it appears on the right, as
+// a run-length merge of the two sorted columns
+int128 similarity_sorted(const long *left, const long *right, size_t n) {
+    int128 similarity = 0;
+    size_t i = 0;
+    size_t j = 0;
+
+    while (i < n && j < n) {
+        long id = left[i];
+        size_t left_run = 0;
+        size_t right_run = 0;
+
+        while (i < n && left[i] == id) {
+            left_run++;
+            i++;
+        }
+        while (j < n && right[j] < id) {
+            j++;
+        }
+        while (j < n && right[j] == id) {
+            right_run++;
+            j++;
+        }
+
+        similarity += (int128)id * left_run * right_run;
+    }
+
+    return similarity;
+}
+
+size_t count_table_slot(const struct count_table *table, long key) {
+    // fibonacci hashing spreads sequential IDs across the table
+    size_t slot = ((unsigned long)key * 11400714819323198485UL) >> table->shift;
+
+    while (table->counts[slot] != 0 && table->keys[slot] != key) {
+        slot = (slot + 1) & table->mask;
+    }
+
+    return slot;
+}
+
+// similarity score without sorting, by counting the right column in a table
+int similarity_hashed(const long *left, const long *right, size_t n, int128 *out) {
+    struct count_table table;
+    size_t capacity = 16;
+    table.shift = 64 - 4;
+
+    // keep the load factor at or below one half
+    while (capacity < 2 * n) {
+        capacity *= 2;
+        table.shift--;
+    }
+
+    table.keys = malloc(capacity * sizeof(long));
+    table.counts = calloc(capacity, sizeof(size_t));
+    table.mask = capacity - 1;
+    if (!table.keys || !table.counts) {
+        free(table.keys);
+        free(table.counts);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    for (size_t i = 0; i < n; i++) {
+        size_t slot = count_table_slot(&table, right[i]);
+        table.keys[slot] = right[i];
+        table.counts[slot]++;
+    }
+
+    int128 similarity = 0;
+    for (size_t i = 0; i < n; i++) {
+        similarity += (int128)left[i] * table.counts[count_table_slot(&table, left[i])];
+    }
+
+    free(table.keys);
+    free(table.counts);
+
+    *out = similarity;
+    return 0;
+}
+
+// read up to capacity pairs, stopping early only at the end of the input
+int read_pairs(FILE *input, long *left, long *right, size_t capacity, size_t *len,
+               char **line, size_t *linecap) {
+    size_t length = 0;
+    ssize_t linelen;
+
+    while (length < capacity && (linelen = getline(line, linecap, input)) != -1) {
+        const char *p = *line;
+        const char *end = *line + linelen;
+
+        // skip blank lines
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            p++;
+        }
+        if (p == end) {
+            continue;
+        }
+
+        if (parse_long(&p, end, &left[length]) != 0) {
+            fprintf(stderr, "failed to parse first number: %s\n", *line);
+            return -1;
+        }
+        if (parse_long(&p, end, &right[length]) != 0) {
+            fprintf(stderr, "failed to parse second number: %s\n", *line);
+            return -1;
+        }
+        length++;
+    }
+
+    *len = length;
+    return 0;
+}
+
+// record a run of n values just written to the end of a run file
+int record_run(struct run_file *runs, size_t n) {
+    if (runs->num_runs >= runs->capacity) {
+        size_t capacity = runs->capacity ? runs->capacity * 2 : 16;
+        off_t *new_offsets = realloc(runs->offsets, capacity * sizeof(off_t));
+        if (new_offsets) {
+            runs->offsets = new_offsets;
+        }
+        size_t *new_lengths = realloc(runs->lengths, capacity * sizeof(size_t));
+        if (new_lengths) {
+            runs->lengths = new_lengths;
+        }
+        if (!new_offsets || !new_lengths) {
+            fprintf(stderr, "realloc failed\n");
+            return -1;
+        }
+        runs->capacity = capacity;
+    }
+
+    off_t offset = runs->num_runs == 0 ? 0
+        : runs->offsets[runs->num_runs - 1] + (off_t)(runs->lengths[runs->num_runs - 1] * sizeof(long));
+
+    runs->offsets[runs->num_runs] = offset;
+    runs->lengths[runs->num_runs] = n;
+    runs->num_runs++;
+    return 0;
+}
+
+// append one sorted run to a run file
+int write_run(struct run_file *runs, const long *values, size_t n) {
+    if (fwrite(values, sizeof(long), n, runs->file) != n) {
+        fprintf(stderr, "error writing temporary file\n");
+        return -1;
+    }
+
+    return record_run(runs, n);
+}
+
+void free_runs(struct run_file *runs) {
+    if (runs->file) {
+        fclose(runs->file);
+    }
+    free(runs->offsets);
+    free(runs->lengths);
+}
+
+// refill a cursor from its run, returns 0 once the run is exhausted
+int run_cursor_fill(struct run_merger *merger, struct run_cursor *cursor) {
+    size_t want = cursor->remaining < merger->buffer_len ? cursor->remaining : merger->buffer_len;
+    if (want == 0) {
+        return 0;
+    }
+
+    ssize_t got = pread(merger->fd, cursor->buffer, want * sizeof(long), cursor->offset);
+    if (got != (ssize_t)(want * sizeof(long))) {
+        fprintf(stderr, "error reading temporary file\n");
+        return -1;
+    }
+
+    cursor->offset += got;
+    cursor->remaining -= want;
+    cursor->pos = 0;
+    cursor->len = want;
+    return 1;
 }
 
-long solve(FILE *input) {
+long run_cursor_value(const struct run_merger *merger, size_t run) {
+    const struct run_cursor *cursor = &merger->cursors[run];
+    return cursor->buffer[cursor->pos];
+}
+
+void run_merger_sift_down(struct run_merger *merger, size_t i) {
+    size_t *heap = merger->heap;
+
+    while (1) {
+        size_t smallest = i;
+        size_t child = 2 * i + 1;
+
+        for (size_t c = child; c < child + 2 && c < merger->heap_len; c++) {
+            if (run_cursor_value(merger, heap[c]) < run_cursor_value(merger, heap[smallest])) {
+                smallest = c;
+            }
+        }
+        if (smallest == i) {
+            return;
+        }
+
+        size_t tmp = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = tmp;
+        i = smallest;
+    }
+}
+
+void run_merger_free(struct run_merger *merger) {
+    free(merger->cursors);
+    free(merger->heap);
+    free(merger->buffers);
+}
+
+// start merging the k runs of a run file from first on, splitting buffer_bytes
+// between them. Callers keep k small enough that each run gets MIN_RUN_BUFFER.
+int run_merger_init(struct run_merger *merger, struct run_file *runs, size_t first, size_t k,
+                    size_t buffer_bytes) {
+    merger->fd = fileno(runs->file);
+    merger->heap_len = 0;
+    merger->buffer_len = buffer_bytes / (k ? k : 1) / sizeof(long);
+
+    merger->cursors = calloc(k ? k : 1, sizeof(struct run_cursor));
+    merger->heap = malloc((k ? k : 1) * sizeof(size_t));
+    merger->buffers = malloc((k ? k : 1) * merger->buffer_len * sizeof(long));
+    if (!merger->cursors || !merger->heap || !merger->buffers) {
+        run_merger_free(merger);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    for (size_t run = 0; run < k; run++) {
+        struct run_cursor *cursor = &merger->cursors[run];
+        cursor->offset = runs->offsets[first + run];
+        cursor->remaining = runs->lengths[first + run];
+        cursor->buffer = merger->buffers + run * merger->buffer_len;
+
+        int status = run_cursor_fill(merger, cursor);
+        if (status == -1) {
+            run_merger_free(merger);
+            return -1;
+        }
+        if (status == 1) {
+            merger->heap[merger->heap_len++] = run;
+        }
+    }
+
+    for (size_t i = merger->heap_len; i-- > 0;) {
+        run_merger_sift_down(merger, i);
+    }
+
+    return 0;
+}
+
+// next smallest value across all runs, returns 0 once every run is exhausted
+int run_merger_next(struct run_merger *merger, long *value) {
+    if (merger->heap_len == 0) {
+        return 0;
+    }
+
+    size_t run = merger->heap[0];
+    struct run_cursor *cursor = &merger->cursors[run];
+    *value = cursor->buffer[cursor->pos++];
+
+    if (cursor->pos == cursor->len) {
+        int status = run_cursor_fill(merger, cursor);
+        if (status == -1) {
+            return -1;
+        }
+        if (status == 0) {
+            merger->heap[0] = merger->heap[--merger->heap_len];
+        }
+    }
+
+    run_merger_sift_down(merger, 0);
+    return 1;
+}
+
+// distance between the two columns, merged from their sorted runs in lockstep
+int merged_distance(struct run_merger *left, struct run_merger *right, uint128 *out) {
+    uint128 total_distance = 0;
+    long a, b;
+    int status;
+
+    while ((status = run_merger_next(left, &a)) == 1) {
+        if (run_merger_next(right, &b) != 1) {
+            return -1;
+        }
+        total_distance += distance_between(a, b);
+    }
+
+    *out = total_distance;
+    return status;
+}
+
+// similarity score as a run-length merge of the two merged columns
+int merged_similarity(struct run_merger *left, struct run_merger *right, int128 *out) {
+    int128 similarity = 0;
+    long a, b;
+    int has_left = run_merger_next(left, &a);
+    int has_right = run_merger_next(right, &b);
+
+    while (has_left == 1 && has_right == 1) {
+        if (b < a) {
+            has_right = run_merger_next(right, &b);
+        } else if (a < b) {
+            has_left = run_merger_next(left, &a);
+        } else {
+            long id = a;
+            long left_run = 0;
+            long right_run = 0;
+
+            while (has_left == 1 && a == id) {
+                left_run++;
+                has_left = run_merger_next(left, &a);
+            }
+            while (has_right == 1 && b == id) {
+                right_run++;
+                has_right = run_merger_next(right, &b);
+            }
+            similarity += (int128)id * left_run * right_run;
+        }
+    }
+
+    if (has_left == -1 || has_right == -1) {
+        return -1;
+    }
+
+    *out = similarity;
+    return 0;
+}
+
+// merge groups of runs into longer ones until all runs left can be merged at
+// once with MIN_RUN_BUFFER IDs each out of buffer_bytes
+int reduce_runs(struct run_file *runs, size_t buffer_bytes) {
+    size_t max_runs = buffer_bytes / (MIN_RUN_BUFFER * sizeof(long));
+    // one run's worth of the budget buffers the merged output
+    size_t fan_in = max_runs - 1;
+    size_t in_bytes = fan_in * MIN_RUN_BUFFER * sizeof(long);
+    long out[MIN_RUN_BUFFER];
+
+    while (runs->num_runs > max_runs) {
+        struct run_file merged = { .file = tmpfile() };
+        struct run_merger merger = {0};
+        int status = 0;
+
+        if (!merged.file) {
+            fprintf(stderr, "error creating temporary file\n");
+            return -1;
+        }
+
+        for (size_t first = 0; first < runs->num_runs && status == 0; first += fan_in) {
+            size_t k = runs->num_runs - first < fan_in ? runs->num_runs - first : fan_in;
+            if (run_merger_init(&merger, runs, first, k, in_bytes) != 0) {
+                status = -1;
+                break;
+            }
+
+            size_t run_len = 0;
+            size_t out_len = 0;
+            long value;
+            while ((status = run_merger_next(&merger, &value)) == 1) {
+                out[out_len++] = value;
+                if (out_len == MIN_RUN_BUFFER) {
+                    if (fwrite(out, sizeof(long), out_len, merged.file) != out_len) {
+                        break;
+                    }
+                    run_len += out_len;
+                    out_len = 0;
+                }
+            }
+            run_merger_free(&merger);
+
+            if (status == 1 || fwrite(out, sizeof(long), out_len, merged.file) != out_len) {
+                fprintf(stderr, "error writing temporary file\n");
+                status = -1;
+            }
+            if (status == 0) {
+                status = record_run(&merged, run_len + out_len);
+            }
+        }
+
+        if (status == 0 && fflush(merged.file) != 0) {
+            fprintf(stderr, "error writing temporary file\n");
+            status = -1;
+        }
+        if (status != 0) {
+            free_runs(&merged);
+            return -1;
+        }
+
+        free_runs(runs);
+        *runs = merged;
+    }
+
+    return 0;
+}
+
+// merge the runs of both columns once per requested metric
+int score_runs(struct run_file *left_runs, struct run_file *right_runs, const struct config *config,
+               struct scores *scores) {
+    // half of the limit feeds the read buffers of each column
+    size_t buffer_bytes = config->memory_limit / 2;
+    struct run_merger left = {0};
+    struct run_merger right = {0};
+    int status = 0;
+
+    if (reduce_runs(left_runs, buffer_bytes) != 0 || reduce_runs(right_runs, buffer_bytes) != 0) {
+        return -1;
+    }
+
+    for (int metric = METRIC_DISTANCE; metric <= METRIC_SIMILARITY && status == 0; metric <<= 1) {
+        if (!(config->metrics & metric)) {
+            continue;
+        }
+
+        if (run_merger_init(&left, left_runs, 0, left_runs->num_runs, buffer_bytes) != 0) {
+            return -1;
+        }
+        if (run_merger_init(&right, right_runs, 0, right_runs->num_runs, buffer_bytes) != 0) {
+            run_merger_free(&left);
+            return -1;
+        }
+
+        if (metric == METRIC_DISTANCE) {
+            status = merged_distance(&left, &right, &scores->distance);
+        } else {
+            status = merged_similarity(&left, &right, &scores->similarity);
+        }
+
+        run_merger_free(&left);
+        run_merger_free(&right);
+    }
+
+    return status;
+}
+
+// sort inputs larger than memory: chunks of at most memory_limit bytes are
+// sorted and spilled as runs, which are then merged back while scoring
+int solve_external(FILE *input, const struct config *config, struct scores *scores) {
+    // each pair needs both IDs plus the radix scratch space for them
+    size_t chunk_pairs = config->memory_limit / (4 * sizeof(long));
+
+    struct run_file left_runs = { .file = tmpfile() };
+    struct run_file right_runs = { .file = tmpfile() };
+    long *left = malloc(chunk_pairs * sizeof(long));
+    long *right = malloc(chunk_pairs * sizeof(long));
+    char *line = NULL;
+    size_t linecap = 0;
+    int status = -1;
+
+    if (!left_runs.file || !right_runs.file) {
+        fprintf(stderr, "error creating temporary file\n");
+        goto done;
+    }
+    if (!left || !right) {
+        fprintf(stderr, "memory allocation failed\n");
+        goto done;
+    }
+
+    size_t n;
+    do {
+        if (read_pairs(input, left, right, chunk_pairs, &n, &line, &linecap) != 0) {
+            goto done;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        if (radix_sort_pair(left, right, n) != 0
+                || write_run(&left_runs, left, n) != 0
+                || write_run(&right_runs, right, n) != 0) {
+            goto done;
+        }
+    } while (n == chunk_pairs);
+
+    // the chunk buffers are not needed while merging
+    free(left);
+    free(right);
+    left = right = NULL;
+
+    if (fflush(left_runs.file) != 0 || fflush(right_runs.file) != 0) {
+        fprintf(stderr, "error writing temporary file\n");
+        goto done;
+    }
+
+    status = score_runs(&left_runs, &right_runs, config, scores);
+
+done:
+    free(line);
+    free(left);
+    free(right);
+    free_runs(&left_runs);
+    free_runs(&right_runs);
+    return status;
+}
+
+int solve(FILE *input, const struct config *config, struct scores *scores) {
     long *left = NULL;
     long *right = NULL;
     size_t n = 0;
 
+    if (config->memory_limit > 0) {
+        if (solve_external(input, config, scores) != 0) {
+            fprintf(stderr, "error reading input\n");
+            return -1;
+        }
+        return 0;
+    }
+
     if (read_input(input, &left, &right, &n) != 0) {
         fprintf(stderr, "error reading input\n");
         return -1;
     }
 
-    qsort(left, n, sizeof(long), sort_asc);
-    qsort(right, n, sizeof(long), sort_asc);
+    // the hash table lets a similarity-only run skip sorting altogether
+    int need_sort = (config->metrics & METRIC_DISTANCE) || !config->hash_count;
 
-    long total_distance = 0;
+    if (need_sort && parallel_sort_pair(left, right, n, config->jobs) != 0) {
+        free(left);
+        free(right);
+        return -1;
+    }
 
-    for (size_t i = 0; i < n; i++) {
-        total_distance += abs(left[i] - right[i]);
+    if (config->metrics & METRIC_DISTANCE) {
+        if (parallel_distance(left, right, n, config->jobs, &scores->distance) != 0) {
+            free(left);
+            free(right);
+            return -1;
+        }
+    }
+
+    if (config->metrics & METRIC_SIMILARITY) {
+        if (config->hash_count) {
+            if (similarity_hashed(left, right, n, &scores->similarity) != 0) {
+                free(left);
+                free(right);
+                return -1;
+            }
+        } else {
+            scores->similarity = similarity_sorted(left, right, n);
+        }
     }
 
     free(left);
     free(right);
 
-    return total_distance;
+    return 0;
+}
+
+// parse a byte count with an optional K, M or G suffix, returns 0 if invalid
+size_t parse_size(const char *arg) {
+    char *end;
+    unsigned long size = strtoul(arg, &end, 10);
+
+    if (end == arg) {
+        return 0;
+    }
+
+    switch (*end) {
+        case 'G': case 'g':
+            size *= 1024;
+            /* fall through */
+        case 'M': case 'm':
+            size *= 1024;
+            /* fall through */
+        case 'K': case 'k':
+            size *= 1024;
+            end++;
+            break;
+    }
+
+    return *end == '\0' ? size : 0;
+}
+
+void print_uint128(FILE *out, uint128 n) {
+    // split into 19 digit chunks that fit in an unsigned long
+    const unsigned long chunk = 10000000000000000000UL;
+    if (n >= chunk) {
+        print_uint128(out, n / chunk);
+        fprintf(out, "%019lu", (unsigned long)(n % chunk));
+    } else {
+        fprintf(out, "%lu", (unsigned long)n);
+    }
+}
+
+void print_int128(FILE *out, int128 n) {
+    if (n < 0) {
+        fputc('-', out);
+        print_uint128(out, -(uint128)n);
+    } else {
+        print_uint128(out, (uint128)n);
+    }
+}
+
+void print_scores(const struct scores *scores, int metrics) {
+    if (metrics & METRIC_DISTANCE) {
+        print_uint128(stdout, scores->distance);
+        fputc('\n', stdout);
+    }
+    if (metrics & METRIC_SIMILARITY) {
+        print_int128(stdout, scores->similarity);
+        fputc('\n', stdout);
+    }
 }
 
 int main(int argc, char **argv) {
     const char *prog = argv[0];
 
     static struct option long_opts[] = {
+        {"distance", no_argument, 0, 'd'},
+        {"similarity", no_argument, 0, 's'},
+        {"hash", no_argument, 0, 'H'},
+        {"jobs", required_argument, 0, 'j'},
+        {"memory-limit", required_argument, 0, 'm'},
         {"help", no_argument, 0, 'h'},
-        {"version", no_argument, 0, 'V'}
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
     };
 
     int opt;
     int opt_index = 0;
+    struct config config = { .jobs = 1 };
 
-    const char *short_opts = "hV";
+    const char *short_opts = "dsHj:m:hV";
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
         switch (opt) {
+            case 'd':
+                config.metrics |= METRIC_DISTANCE;
+                break;
+            case 's':
+                config.metrics |= METRIC_SIMILARITY;
+                break;
+            case 'H':
+                config.hash_count = 1;
+                break;
+            case 'j':
+                config.jobs = atoi(optarg);
+                if (config.jobs < 1) {
+                    fprintf(stderr, "invalid number of jobs: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'm':
+                if ((config.memory_limit = parse_size(optarg)) == 0) {
+                    fprintf(stderr, "invalid memory limit: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                if (config.memory_limit < MIN_MEMORY_LIMIT) {
+                    fprintf(stderr, "memory limit too small: %s (at least %zuK)\n",
+                            optarg, MIN_MEMORY_LIMIT / 1024);
+                    return EXIT_FAILURE;
+                }
+                break;
             case 'h':
                 usage(stdout, prog);
                 return EXIT_SUCCESS;
@@ -169,15 +1384,29 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (config.metrics == 0) {
+        config.metrics = METRIC_DISTANCE;
+    }
+
+    if (config.hash_count && config.memory_limit > 0) {
+        fprintf(stderr, "--hash cannot be combined with --memory-limit\n");
+        return EXIT_FAILURE;
+    }
+
+    if (config.jobs > 1 && config.memory_limit > 0) {
+        fprintf(stderr, "--jobs cannot be combined with --memory-limit\n");
+        return EXIT_FAILURE;
+    }
+
+    struct scores scores;
+
     if (optind == argc) {
-        long total_distance;
-        if ((total_distance = solve(stdin)) == -1) {
+        if (solve(stdin, &config, &scores) == -1) {
             return EXIT_FAILURE;
         }
-        fprintf(stdout, "%ld\n", total_distance);
+        print_scores(&scores, config.metrics);
     } else {
         FILE *file_ptr;
-        long total_distance;
 
         for (int i = optind; i < argc; i++) {
             const char *filename = argv[i];
@@ -188,12 +1417,12 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
 
-            if ((total_distance = solve(file_ptr)) == -1) {
+            if (solve(file_ptr, &config, &scores) == -1) {
                 fclose(file_ptr);
                 return EXIT_FAILURE;
             }
 
-            fprintf(stdout, "%ld\n", total_distance);
+            print_scores(&scores, config.metrics);
             fclose(file_ptr);
         }
     }
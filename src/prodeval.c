@@ -14,10 +14,125 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 128-bit accumulator for sums of repeated-digit IDs, which can overflow a long
+__extension__ typedef __int128 int128;
+__extension__ typedef unsigned __int128 uint128;
+
+// 10^0 .. 10^19, enough to bound every digit length of a long
+const unsigned long pow10_table[20] = {
+    1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL, 10000000UL,
+    100000000UL, 1000000000UL, 10000000000UL, 100000000000UL,
+    1000000000000UL, 10000000000000UL, 100000000000000UL,
+    1000000000000000UL, 10000000000000000UL, 100000000000000000UL,
+    1000000000000000000UL, 10000000000000000000UL
+};
+
+// 10...010...01 multipliers for each prime number of repeats of a length,
+// zero terminated
+const unsigned long period_multipliers[20][2] = {
+    {0UL, 0UL},
+    {0UL, 0UL},
+    {11UL, 0UL},
+    {111UL, 0UL},
+    {101UL, 0UL},
+    {11111UL, 0UL},
+    {1001UL, 10101UL},
+    {1111111UL, 0UL},
+    {10001UL, 0UL},
+    {1001001UL, 0UL},
+    {100001UL, 101010101UL},
+    {11111111111UL, 0UL},
+    {1000001UL, 100010001UL},
+    {1111111111111UL, 0UL},
+    {10000001UL, 1010101010101UL},
+    {10000100001UL, 1001001001001UL},
+    {100000001UL, 0UL},
+    {11111111111111111UL, 0UL},
+    {1000000001UL, 1000001000001UL},
+    {1111111111111111111UL, 0UL}
+};
+
+// IDs validated per batch call, one vector lane each
+#define BATCH_WIDTH 8
+#define BATCH_LANE_OFFSETS {0, 1, 2, 3, 4, 5, 6, 7}
+
+typedef long batch_vec __attribute__((vector_size(BATCH_WIDTH * sizeof(long))));
+
+// narrowest sub-range worth handing to a thread when scanning every ID
+#define MIN_UNIT_WIDTH 65536UL
+// work units created per thread when splitting wide ranges
+#define UNITS_PER_JOB 16
+// bytes of input read at a time, ranges may straddle reads
+#define READ_CHUNK_SIZE 65536
+// ranges buffered for the thread pool before a batch is evaluated
+#define MAX_QUEUED_RANGES 1048576
+
+struct range_reader {
+    FILE *input;
+    char buffer[READ_CHUNK_SIZE];
+    size_t pos;
+    size_t len;
+    size_t total_read;
+};
+
+#define INDEX_MAGIC "PRODIDX"
+#define INDEX_VERSION 1
+// largest ID listed in a new index unless --index-limit says otherwise
+#define DEFAULT_INDEX_LIMIT 1000000000000L
+
+// On-disk index of every invalid ID up to max_id, in native byte order.
+// The header is followed by count sorted IDs and then count + 1 prefix
+// sums, each stored as the low and high 64 bits of a 128-bit total.
+struct index_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t at_least_twice;
+    uint64_t count;
+    int64_t max_id;
+};
+
+struct id_index {
+    void *map;
+    size_t map_size;
+    const struct index_header *header;
+    const int64_t *ids;
+    const uint64_t (*prefix_sums)[2];
+};
+
+struct work_unit {
+    long l_bound;
+    long u_bound;
+};
+
+struct work_queue {
+    struct work_unit *units;
+    size_t len;
+    size_t capacity;
+    atomic_size_t next;
+    int (*validator)(long);
+    int can_generate;
+    const struct id_index *index;
+};
+
+struct worker {
+    pthread_t thread;
+    struct work_queue *queue;
+    int128 partial_sum;
+};
 
 void usage(FILE *out, const char *prog) {
     fprintf(out, 
@@ -29,108 +144,758 @@ void usage(FILE *out, const char *prog) {
         "An invalid product ID is defined as one that consists of a sequence of digits repeated any number of times.\n"
         "\n"
         "Options:\n"
-        "   -2, --twice     Check for product IDs repeated exactly twice\n"
-        "   -h, --help      Display this help and exit\n"
-        "   -V, --version   Display version information and exit\n",
+        "   -2, --twice         Check for product IDs repeated exactly twice\n"
+        "   -b, --brute-force   Test every ID in each range instead of generating invalid IDs\n"
+        "   -j, --jobs=N        Evaluate ranges on N threads (default: 1)\n"
+        "   -i, --index=FILE    Answer ranges from an index built with --build-index\n"
+        "   -I, --build-index=FILE\n"
+        "                       Write an index of every invalid ID to FILE and exit\n"
+        "   -L, --index-limit=N Largest ID listed by --build-index (default: 10^12)\n"
+        "   -h, --help          Display this help and exit\n"
+        "   -V, --version       Display version information and exit\n",
         prog
     );
 }
 
-int has_n_repeats(char* id, size_t n) {
-    size_t length = strlen(id);
-    char to_check;
+// number of decimal digits in id
+int digit_count(unsigned long id) {
+    int length = 1;
+    while (length < 20 && id >= pow10_table[length]) {
+        length++;
+    }
+    return length;
+}
+
+// An ID of length digits is a block of length / k digits repeated k times
+// exactly when it is divisible by 10...010...01 (k ones). Only prime k need
+// checking, since repeating k times also repeats every prime factor of k times.
+int is_repeated_at_least_twice(long id) {
+    if (id <= 0) {
+        return 0;
+    }
+
+    // constant divisors let the compiler replace each division with a multiply
+    switch (digit_count(id)) {
+        case 2: return id % 11UL == 0;
+        case 3: return id % 111UL == 0;
+        case 4: return id % 101UL == 0;
+        case 5: return id % 11111UL == 0;
+        case 6: return id % 1001UL == 0 || id % 10101UL == 0;
+        case 7: return id % 1111111UL == 0;
+        case 8: return id % 10001UL == 0;
+        case 9: return id % 1001001UL == 0;
+        case 10: return id % 100001UL == 0 || id % 101010101UL == 0;
+        case 11: return id % 11111111111UL == 0;
+        case 12: return id % 1000001UL == 0 || id % 100010001UL == 0;
+        case 13: return id % 1111111111111UL == 0;
+        case 14: return id % 10000001UL == 0 || id % 1010101010101UL == 0;
+        case 15: return id % 10000100001UL == 0 || id % 1001001001001UL == 0;
+        case 16: return id % 100000001UL == 0;
+        case 17: return id % 11111111111111111UL == 0;
+        case 18: return id % 1000000001UL == 0 || id % 1000001000001UL == 0;
+        case 19: return id % 1111111111111111111UL == 0;
+        default: return 0;
+    }
+}
+
+int is_repeated_twice(long id) {
+    if (id <= 0) {
+        return 0;
+    }
+
+    // not repeated twice if odd number of digits
+    switch (digit_count(id)) {
+        case 2: return id % 11UL == 0;
+        case 4: return id % 101UL == 0;
+        case 6: return id % 1001UL == 0;
+        case 8: return id % 10001UL == 0;
+        case 10: return id % 100001UL == 0;
+        case 12: return id % 1000001UL == 0;
+        case 14: return id % 10000001UL == 0;
+        case 16: return id % 100000001UL == 0;
+        case 18: return id % 1000000001UL == 0;
+        default: return 0;
+    }
+}
+
+// bit i is set if first + i is invalid, for the multiplier of each period
+unsigned batch_mask(long first, const unsigned long *multipliers, size_t count) {
+    const batch_vec lane_offsets = BATCH_LANE_OFFSETS;
+    batch_vec hits = {0};
+
+    for (size_t m = 0; m < count && multipliers[m] != 0; m++) {
+        // consecutive IDs have consecutive remainders, and every multiplier is
+        // larger than the batch, so one division covers all lanes
+        long multiplier = multipliers[m];
+        batch_vec remainders = lane_offsets + (long)((unsigned long)first % multiplier);
+        hits |= (remainders == 0) | (remainders == multiplier);
+    }
+
+    unsigned mask = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++) {
+        mask |= (unsigned)(hits[i] & 1) << i;
+    }
+    return mask;
+}
+
+// validate first .. first + BATCH_WIDTH - 1 with a scalar validator
+unsigned batch_mask_scalar(long first, int (*validator)(long)) {
+    unsigned mask = 0;
+    for (int i = 0; i < BATCH_WIDTH; i++) {
+        mask |= (unsigned)(validator(first + i) != 0) << i;
+    }
+    return mask;
+}
+
+// batched is_repeated_at_least_twice over BATCH_WIDTH consecutive IDs
+unsigned is_repeated_at_least_twice_batch(long first) {
+    int length = digit_count(first);
+    if (first <= 0 || digit_count(first + BATCH_WIDTH - 1) != length) {
+        return batch_mask_scalar(first, is_repeated_at_least_twice);
+    }
+
+    return batch_mask(first, period_multipliers[length], 2);
+}
+
+// batched is_repeated_twice over BATCH_WIDTH consecutive IDs
+unsigned is_repeated_twice_batch(long first) {
+    int length = digit_count(first);
+    if (first <= 0 || digit_count(first + BATCH_WIDTH - 1) != length) {
+        return batch_mask_scalar(first, is_repeated_twice);
+    }
+    if (length % 2 != 0) {
+        return 0;
+    }
+
+    unsigned long multiplier = pow10_table[length / 2] + 1;
+    return batch_mask(first, &multiplier, 1);
+}
+
+// sum of all IDs in [l_bound, u_bound] that are a block of block_len digits
+// repeated to id_len digits, i.e. block * 10...010...01 for every block that
+// has exactly block_len digits
+int128 sum_periodic(long l_bound, long u_bound, int id_len, int block_len) {
+    unsigned long multiplier = (pow10_table[id_len] - 1) / (pow10_table[block_len] - 1);
+    unsigned long lo = (unsigned long)l_bound;
+    unsigned long hi = (unsigned long)u_bound;
+
+    unsigned long first_block = pow10_table[block_len - 1];
+    unsigned long last_block = pow10_table[block_len] - 1;
+
+    // clamp blocks so that block * multiplier lands inside the range
+    unsigned long lo_block = (lo + multiplier - 1) / multiplier;
+    unsigned long hi_block = hi / multiplier;
+    if (lo_block > first_block) first_block = lo_block;
+    if (hi_block < last_block) last_block = hi_block;
+
+    if (first_block > last_block) {
+        return 0;
+    }
 
-    // starting with char at index j
-    for (size_t j = 0; j < n; j++) {
-        to_check = id[j];
+    // arithmetic series over the blocks
+    int128 count = last_block - first_block + 1;
+    int128 block_sum = ((int128)first_block + last_block) * count / 2;
+    return block_sum * multiplier;
+}
 
-        // check every nth number
-        for (size_t i = j; i < length; i += n) {
-            if (id[i] != to_check) {
+// moebius function of small n, used to remove IDs counted under several block lengths
+int moebius(int n) {
+    int result = 1;
+    for (int p = 2; p * p <= n; p++) {
+        if (n % p == 0) {
+            n /= p;
+            if (n % p == 0) {
                 return 0;
             }
+            result = -result;
         }
     }
+    if (n > 1) {
+        result = -result;
+    }
+    return result;
+}
 
-    return 1;
+// sum of invalid IDs in [l_bound, u_bound] without visiting the valid ones.
+// An ID of id_len digits built from repeats of a shorter block is periodic with
+// some period id_len / k, so the union over every k > 1 dividing id_len is
+// summed by inclusion-exclusion over the squarefree k.
+int128 sum_repeated_in_range(long l_bound, long u_bound, int at_least_twice) {
+    int128 total_sum = 0;
+
+    if (l_bound < 1) {
+        l_bound = 1;
+    }
+    if (u_bound < l_bound) {
+        return 0;
+    }
+
+    for (int id_len = 2; id_len <= 19; id_len++) {
+        if (pow10_table[id_len - 1] > (unsigned long)u_bound) {
+            break;
+        }
+
+        if (!at_least_twice) {
+            if (id_len % 2 == 0) {
+                total_sum += sum_periodic(l_bound, u_bound, id_len, id_len / 2);
+            }
+            continue;
+        }
+
+        for (int k = 2; k <= id_len; k++) {
+            if (id_len % k != 0) {
+                continue;
+            }
+            int mu = moebius(k);
+            if (mu != 0) {
+                total_sum -= mu * sum_periodic(l_bound, u_bound, id_len, id_len / k);
+            }
+        }
+    }
+
+    return total_sum;
 }
 
-int is_repeated_at_least_twice(long id) {
-    char num_str[20];
-    // convert number to string
-    sprintf(num_str, "%ld", id);
+int compare_ids(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a;
+    int64_t y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
 
-    size_t length = strlen(num_str);
+// write a sorted index of every invalid ID up to limit, with prefix sums
+int build_index(const char *path, int at_least_twice, long limit) {
+    size_t capacity = 1024;
+    size_t count = 0;
+    int64_t *ids = malloc(capacity * sizeof(int64_t));
+    if (!ids) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    // list block * multiplier for every prime repeat count, which covers the
+    // other repeat counts as well
+    for (int id_len = 2; id_len <= 19 && pow10_table[id_len - 1] <= (unsigned long)limit; id_len++) {
+        unsigned long twice_multiplier = pow10_table[id_len / 2] + 1;
+        const unsigned long *multipliers = period_multipliers[id_len];
+        size_t num_multipliers = 2;
 
-    for (size_t n = 1; n < length; n++) {
-        // check if n is a factor of length
-        if (length % n == 0) {
-            if (has_n_repeats(num_str, n)) {
-                return 1;
+        if (!at_least_twice) {
+            if (id_len % 2 != 0) {
+                continue;
             }
+            multipliers = &twice_multiplier;
+            num_multipliers = 1;
+        }
+
+        for (size_t m = 0; m < num_multipliers && multipliers[m] != 0; m++) {
+            unsigned long multiplier = multipliers[m];
+            int block_len = id_len - digit_count(multiplier) + 1;
+
+            for (unsigned long block = pow10_table[block_len - 1]; block < pow10_table[block_len]; block++) {
+                unsigned long id = block * multiplier;
+                if (id > (unsigned long)limit) {
+                    break;
+                }
+
+                // grow array if needed
+                if (count >= capacity) {
+                    capacity *= 2;
+                    int64_t *new_ids = realloc(ids, capacity * sizeof(int64_t));
+                    if (!new_ids) {
+                        free(ids);
+                        fprintf(stderr, "realloc failed\n");
+                        return -1;
+                    }
+                    ids = new_ids;
+                }
+                ids[count++] = (int64_t)id;
+            }
+        }
+    }
+
+    // IDs repeated under several block lengths were listed more than once
+    qsort(ids, count, sizeof(int64_t), compare_ids);
+    size_t unique = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique == 0 || ids[unique - 1] != ids[i]) {
+            ids[unique++] = ids[i];
         }
     }
+    count = unique;
+
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        free(ids);
+        fprintf(stderr, "error opening file: %s\n", path);
+        return -1;
+    }
+
+    struct index_header header = {
+        .magic = INDEX_MAGIC,
+        .version = INDEX_VERSION,
+        .at_least_twice = at_least_twice,
+        .count = count,
+        .max_id = limit
+    };
+
+    int failed = fwrite(&header, sizeof(header), 1, out) != 1
+        || fwrite(ids, sizeof(int64_t), count, out) != count;
+
+    uint128 prefix_sum = 0;
+    for (size_t i = 0; i <= count && !failed; i++) {
+        uint64_t halves[2] = { (uint64_t)prefix_sum, (uint64_t)(prefix_sum >> 64) };
+        failed = fwrite(halves, sizeof(halves), 1, out) != 1;
+        if (i < count) {
+            prefix_sum += ids[i];
+        }
+    }
+
+    free(ids);
+    if (fclose(out) != 0 || failed) {
+        fprintf(stderr, "error writing index: %s\n", path);
+        return -1;
+    }
 
     return 0;
 }
 
-int is_repeated_twice(long id) {
-    char num_str[20];
-    // convert number to string
-    sprintf(num_str, "%ld", id);
+// map an index written by build_index for the same kind of invalid ID
+int load_index(const char *path, int at_least_twice, struct id_index *index) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "error opening file: %s\n", path);
+        return -1;
+    }
 
-    size_t length = strlen(num_str);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(struct index_header)) {
+        close(fd);
+        fprintf(stderr, "bad index: %s\n", path);
+        return -1;
+    }
 
-    // not repeated twice if odd number of digits
-    if (length % 2 != 0) {
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "error mapping index: %s\n", path);
+        return -1;
+    }
+
+    const struct index_header *header = map;
+    // each ID takes an int64_t and a 128-bit prefix sum, so a count that
+    // could not fit in the file is rejected before it can overflow the size
+    size_t max_count = (size_t)st.st_size / (sizeof(int64_t) + 2 * sizeof(uint64_t));
+    size_t expected_size = header->count > max_count ? 0
+        : sizeof(struct index_header)
+            + header->count * sizeof(int64_t)
+            + (header->count + 1) * 2 * sizeof(uint64_t);
+
+    if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0
+            || header->version != INDEX_VERSION
+            || header->count > max_count
+            || (size_t)st.st_size != expected_size) {
+        munmap(map, st.st_size);
+        fprintf(stderr, "bad index: %s\n", path);
+        return -1;
+    }
+
+    if (header->at_least_twice != (uint32_t)at_least_twice) {
+        munmap(map, st.st_size);
+        fprintf(stderr, "index %s was built %s --twice\n", path, at_least_twice ? "with" : "without");
+        return -1;
+    }
+
+    index->map = map;
+    index->map_size = st.st_size;
+    index->header = header;
+    index->ids = (const int64_t *)(header + 1);
+    index->prefix_sums = (const uint64_t (*)[2])(index->ids + header->count);
+    return 0;
+}
+
+void free_index(struct id_index *index) {
+    if (index->map) {
+        munmap(index->map, index->map_size);
+    }
+}
+
+// number of indexed IDs less than id, or at most id when inclusive is set
+size_t index_rank(const struct id_index *index, long id, int inclusive) {
+    size_t lo = 0;
+    size_t hi = index->header->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->ids[mid] < id || (inclusive && index->ids[mid] == id)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo;
+}
+
+int128 index_prefix_sum(const struct id_index *index, size_t rank) {
+    const uint64_t *halves = index->prefix_sums[rank];
+    return (int128)(((uint128)halves[1] << 64) | halves[0]);
+}
+
+// sum invalid ids in [l_bound, u_bound] with two binary searches, generating
+// any part of the range above the largest indexed ID
+int128 index_sum(const struct id_index *index, long l_bound, long u_bound) {
+    long max_id = index->header->max_id;
+    int128 total_sum = 0;
+
+    if (l_bound < 1) {
+        l_bound = 1;
+    }
+    if (u_bound < l_bound) {
+        return 0;
+    }
+
+    if (l_bound <= max_id) {
+        long upper = u_bound < max_id ? u_bound : max_id;
+        // an inclusive rank avoids upper + 1, which overflows when max_id is LONG_MAX
+        total_sum = index_prefix_sum(index, index_rank(index, upper, 1))
+            - index_prefix_sum(index, index_rank(index, l_bound, 0));
+    }
+
+    if (u_bound > max_id) {
+        long lower = l_bound > max_id ? l_bound : max_id + 1;
+        total_sum += sum_repeated_in_range(lower, u_bound, index->header->at_least_twice);
+    }
+
+    return total_sum;
+}
+
+// sum invalid ids in [l_bound, u_bound]
+int128 sum_range(long l_bound, long u_bound, int (*validator)(long), int can_generate,
+                 const struct id_index *index) {
+    int128 total_sum = 0;
+
+    if (index) {
+        return index_sum(index, l_bound, u_bound);
+    }
+
+    if (can_generate) {
+        return sum_repeated_in_range(l_bound, u_bound, validator == is_repeated_at_least_twice);
+    }
+
+    unsigned (*batch_validator)(long) = NULL;
+    if (validator == is_repeated_twice) {
+        batch_validator = is_repeated_twice_batch;
+    } else if (validator == is_repeated_at_least_twice) {
+        batch_validator = is_repeated_at_least_twice_batch;
+    }
+
+    if (u_bound < l_bound) {
         return 0;
     }
 
-    // compare both halves of number
-    for (size_t i = 0; i < length / 2; i++) {
-        size_t j = i + (length / 2);
-        if (num_str[i] != num_str[j]) {
-            return 0;
+    // counted rather than compared against u_bound so LONG_MAX cannot overflow
+    unsigned long remaining = (unsigned long)u_bound - (unsigned long)l_bound + 1;
+    long i = l_bound;
+
+    if (batch_validator) {
+        for (; remaining >= BATCH_WIDTH; remaining -= BATCH_WIDTH) {
+            unsigned mask = batch_validator(i);
+            while (mask) {
+                total_sum += i + __builtin_ctz(mask);
+                mask &= mask - 1;
+            }
+            if (remaining > BATCH_WIDTH) {
+                i += BATCH_WIDTH;
+            }
+        }
+    }
+
+    for (; remaining > 0; remaining--) {
+        if (validator(i)) {
+            total_sum += i;
+        }
+        if (remaining > 1) {
+            i++;
+        }
+    }
+
+    return total_sum;
+}
+
+int push_unit(struct work_queue *queue, long l_bound, long u_bound) {
+    // grow array if needed
+    if (queue->len >= queue->capacity) {
+        size_t capacity = queue->capacity ? queue->capacity * 2 : 16;
+        struct work_unit *new_units = realloc(queue->units, capacity * sizeof(struct work_unit));
+        if (!new_units) {
+            fprintf(stderr, "realloc failed\n");
+            return -1;
+        }
+        queue->units = new_units;
+        queue->capacity = capacity;
+    }
+
+    queue->units[queue->len].l_bound = l_bound;
+    queue->units[queue->len].u_bound = u_bound;
+    queue->len++;
+    return 0;
+}
+
+// cut ranges wider than unit_width into sub-ranges so no single range keeps one thread busy
+int split_units(struct work_queue *queue, unsigned long unit_width) {
+    struct work_queue split = {0};
+
+    for (size_t i = 0; i < queue->len; i++) {
+        long l_bound = queue->units[i].l_bound;
+        long u_bound = queue->units[i].u_bound;
+
+        while (u_bound >= l_bound && (unsigned long)u_bound - (unsigned long)l_bound >= unit_width) {
+            long sub_u_bound = (long)((unsigned long)l_bound + unit_width - 1);
+            if (push_unit(&split, l_bound, sub_u_bound) != 0) {
+                free(split.units);
+                return -1;
+            }
+            l_bound = sub_u_bound + 1;
+        }
+
+        if (u_bound >= l_bound && push_unit(&split, l_bound, u_bound) != 0) {
+            free(split.units);
+            return -1;
+        }
+    }
+
+    free(queue->units);
+    queue->units = split.units;
+    queue->len = split.len;
+    queue->capacity = split.capacity;
+    return 0;
+}
+
+void *run_worker(void *arg) {
+    struct worker *worker = arg;
+    struct work_queue *queue = worker->queue;
+    size_t i;
+
+    while ((i = atomic_fetch_add(&queue->next, 1)) < queue->len) {
+        struct work_unit *unit = &queue->units[i];
+        worker->partial_sum += sum_range(unit->l_bound, unit->u_bound,
+            queue->validator, queue->can_generate, queue->index);
+    }
+
+    return NULL;
+}
+
+// evaluate all queued ranges on a pool of jobs threads, storing their sum in out
+int evaluate_parallel(struct work_queue *queue, int jobs, int128 *out) {
+    if (!queue->can_generate && !queue->index) {
+        // scanning costs grow with width, so balance by splitting wide ranges
+        unsigned long total_width = 0;
+        for (size_t i = 0; i < queue->len; i++) {
+            if (queue->units[i].u_bound >= queue->units[i].l_bound) {
+                total_width += (unsigned long)queue->units[i].u_bound
+                    - (unsigned long)queue->units[i].l_bound + 1;
+            }
+        }
+
+        unsigned long unit_width = total_width / ((unsigned long)jobs * UNITS_PER_JOB);
+        if (unit_width < MIN_UNIT_WIDTH) {
+            unit_width = MIN_UNIT_WIDTH;
+        }
+        if (split_units(queue, unit_width) != 0) {
+            return -1;
+        }
+    }
+
+    struct worker *workers = calloc(jobs, sizeof(struct worker));
+    if (!workers) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    atomic_init(&queue->next, 0);
+
+    int started = 0;
+    for (; started < jobs; started++) {
+        workers[started].queue = queue;
+        if (pthread_create(&workers[started].thread, NULL, run_worker, &workers[started]) != 0) {
+            fprintf(stderr, "failed to start thread\n");
+            break;
+        }
+    }
+
+    // threads that failed to start are covered by the main thread draining the queue
+    struct worker self = { .queue = queue };
+    if (started < jobs) {
+        run_worker(&self);
+    }
+
+    // reduce in thread order so the result does not depend on scheduling
+    int128 total_sum = self.partial_sum;
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        total_sum += workers[i].partial_sum;
+    }
+
+    free(workers);
+    *out = total_sum;
+    return 0;
+}
+
+// next input character, or EOF once the input is exhausted
+int next_char(struct range_reader *reader) {
+    if (reader->pos == reader->len) {
+        reader->len = fread(reader->buffer, 1, sizeof(reader->buffer), reader->input);
+        reader->pos = 0;
+        reader->total_read += reader->len;
+        if (reader->len == 0) {
+            return EOF;
+        }
+    }
+
+    return (unsigned char)reader->buffer[reader->pos++];
+}
+
+// read the next "lower-upper" range, where ranges are separated by commas or
+// newlines. Returns 1 when a range was read, 0 at end of input, -1 on error.
+int read_range(struct range_reader *reader, long *l_bound, long *u_bound) {
+    unsigned long bounds[2] = {0, 0};
+    int bound = 0;
+    int has_digits = 0;
+    // a blank after digits ends the bound, so no more digits may follow it
+    int bound_ended = 0;
+    int c;
+
+    while (1) {
+        c = next_char(reader);
+
+        if (c >= '0' && c <= '9') {
+            if (bound_ended) {
+                fprintf(stderr, "bad range: unexpected blank inside a bound\n");
+                return -1;
+            }
+            unsigned long digit = c - '0';
+            if (bounds[bound] > (9223372036854775807UL - digit) / 10) {
+                fprintf(stderr, "range bound out of range\n");
+                return -1;
+            }
+            bounds[bound] = bounds[bound] * 10 + digit;
+            has_digits = 1;
+        } else if (c == '-') {
+            if (bound != 0 || !has_digits) {
+                fprintf(stderr, "bad range: unexpected '-'\n");
+                return -1;
+            }
+            bound = 1;
+            has_digits = 0;
+            bound_ended = 0;
+        } else if (c == ',' || c == '\n' || c == EOF) {
+            if (bound == 1 && has_digits) {
+                break;
+            }
+            if (bound != 0 || has_digits) {
+                fprintf(stderr, "bad range: missing upper bound\n");
+                return -1;
+            }
+            // empty entry between separators
+            if (c == EOF) {
+                if (ferror(reader->input)) {
+                    fprintf(stderr, "error reading input\n");
+                    return -1;
+                }
+                return 0;
+            }
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            bound_ended = has_digits;
+        } else {
+            fprintf(stderr, "bad range: unexpected character '%c'\n", c);
+            return -1;
         }
     }
 
+    *l_bound = (long)bounds[0];
+    *u_bound = (long)bounds[1];
     return 1;
 }
 
-// process input and calculate total sum of invalid product IDs using validator function
-long solve(FILE *input, int (*validator)(long)) {
-    char buffer[1024];
-    char* delims = "-,";
-    char* token;
+// process input and calculate total sum of invalid product IDs using validator function,
+// storing it in out. Returns 0 on success, -1 on error.
+int solve(FILE *input, int (*validator)(long), int brute_force, int jobs,
+          const struct id_index *index, int128 *out) {
+    struct range_reader reader = { .input = input };
     long l_bound;
     long u_bound;
-    long total_sum = 0;
+    int128 total_sum = 0;
+    int128 batch_sum;
+    int status;
+
+    // known validators are answered by generating their invalid IDs directly
+    int can_generate = !brute_force
+        && (validator == is_repeated_twice || validator == is_repeated_at_least_twice);
+
+    struct work_queue queue = {
+        .validator = validator,
+        .can_generate = can_generate,
+        .index = index
+    };
 
-    if (fgets(buffer, sizeof(buffer), input) == NULL) {
-        fprintf(stderr, "error reading input\n");
-        return -1;
-    }
+    while ((status = read_range(&reader, &l_bound, &u_bound)) == 1) {
+        if (jobs == 1) {
+            total_sum += sum_range(l_bound, u_bound, validator, can_generate, index);
+            continue;
+        }
 
-    // split input by "-" and "," characters
-    token = strtok(buffer, delims);
-    while (token != NULL) {
-        // get lower and upper bound from each range
-        l_bound = strtol(token, NULL, 10);
-        token = strtok(NULL, delims);
-        u_bound = strtol(token, NULL, 10);
+        if (push_unit(&queue, l_bound, u_bound) != 0) {
+            free(queue.units);
+            return -1;
+        }
 
-        // sum invalid ids in this range
-        for (long i = l_bound; i <= u_bound; i++) {
-            if (validator(i)) {
-                total_sum += i;
+        // evaluate in batches so memory stays bounded on long range lists
+        if (queue.len >= MAX_QUEUED_RANGES) {
+            if (evaluate_parallel(&queue, jobs, &batch_sum) != 0) {
+                free(queue.units);
+                return -1;
             }
+            total_sum += batch_sum;
+            queue.len = 0;
         }
+    }
 
-        // move on to next range
-        token = strtok(NULL, delims);
+    if (status == 0 && reader.total_read == 0) {
+        fprintf(stderr, "error reading input\n");
+        status = -1;
     }
 
-    return total_sum;
+    if (status == 0 && queue.len > 0) {
+        if (evaluate_parallel(&queue, jobs, &batch_sum) != 0) {
+            status = -1;
+        } else {
+            total_sum += batch_sum;
+        }
+    }
+
+    free(queue.units);
+    if (status == -1) {
+        return -1;
+    }
+
+    *out = total_sum;
+    return 0;
+}
+
+void print_int128(FILE *out, int128 n) {
+    uint128 magnitude = n < 0 ? -(uint128)n : (uint128)n;
+    if (n < 0) {
+        fputc('-', out);
+    }
+
+    // split into 19 digit chunks that fit in an unsigned long
+    const unsigned long chunk = 10000000000000000000UL;
+    if (magnitude >= chunk) {
+        print_int128(out, (int128)(magnitude / chunk));
+        fprintf(out, "%019lu", (unsigned long)(magnitude % chunk));
+    } else {
+        fprintf(out, "%lu", (unsigned long)magnitude);
+    }
 }
 
 int main(int argc, char **argv) {
@@ -138,21 +903,56 @@ int main(int argc, char **argv) {
 
     static struct option long_opts[] = {
         {"twice", no_argument, 0, '2'},
+        {"brute-force", no_argument, 0, 'b'},
+        {"jobs", required_argument, 0, 'j'},
+        {"index", required_argument, 0, 'i'},
+        {"build-index", required_argument, 0, 'I'},
+        {"index-limit", required_argument, 0, 'L'},
         {"help", no_argument, 0, 'h'},
-        {"version", no_argument, 0, 'V'}
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
     };
 
     int opt;
     int opt_index = 0;
     int check_twice = 0;
+    int brute_force = 0;
+    int jobs = 1;
+    const char *index_path = NULL;
+    const char *build_path = NULL;
+    long index_limit = DEFAULT_INDEX_LIMIT;
+    char *end;
 
-    const char *short_opts = "2hV";
+    const char *short_opts = "2bj:i:I:L:hV";
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
         switch (opt) {
             case '2':
                 check_twice = 1;
                 break;
+            case 'b':
+                brute_force = 1;
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                if (jobs < 1) {
+                    fprintf(stderr, "invalid number of jobs: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'i':
+                index_path = optarg;
+                break;
+            case 'I':
+                build_path = optarg;
+                break;
+            case 'L':
+                index_limit = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || index_limit < 1) {
+                    fprintf(stderr, "invalid index limit: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
             case 'h':
                 usage(stdout, prog);
                 return EXIT_SUCCESS;
@@ -166,15 +966,34 @@ int main(int argc, char **argv) {
     }
     int (*validator)(long) = check_twice ? is_repeated_twice : is_repeated_at_least_twice;
 
+    if (build_path) {
+        return build_index(build_path, !check_twice, index_limit) == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    struct id_index index = {0};
+    struct id_index *index_ptr = NULL;
+    if (index_path) {
+        if (brute_force) {
+            fprintf(stderr, "--index and --brute-force cannot be combined\n");
+            return EXIT_FAILURE;
+        }
+        if (load_index(index_path, !check_twice, &index) != 0) {
+            return EXIT_FAILURE;
+        }
+        index_ptr = &index;
+    }
+
     if (optind == argc) {
-        long answer;
-        if ((answer = solve(stdin, validator)) == -1) {
+        int128 answer;
+        if (solve(stdin, validator, brute_force, jobs, index_ptr, &answer) != 0) {
+            free_index(&index);
             return EXIT_FAILURE;
         }
-        fprintf(stdout, "%ld\n", answer);
+        print_int128(stdout, answer);
+        fputc('\n', stdout);
     } else {
         FILE *file_ptr;
-        long answer;
+        int128 answer;
 
         for (int i = optind; i < argc; i++) {
             const char *filename = argv[i];
@@ -182,18 +1001,22 @@ int main(int argc, char **argv) {
             file_ptr = fopen(filename, "r");
             if (file_ptr == NULL) {
                 fprintf(stderr, "error opening file: %s\n", filename);
+                free_index(&index);
                 return EXIT_FAILURE;
             }
 
-            if ((answer = solve(file_ptr, validator)) == -1) {
+            if (solve(file_ptr, validator, brute_force, jobs, index_ptr, &answer) != 0) {
                 fclose(file_ptr);
+                free_index(&index);
                 return EXIT_FAILURE;
             }
 
-            fprintf(stdout, "%ld\n", answer);
+            print_int128(stdout, answer);
+            fputc('\n', stdout);
             fclose(file_ptr);
         }
     }
 
+    free_index(&index);
     return EXIT_SUCCESS;
 }
@@ -14,11 +14,150 @@
    You should have received a copy of the GNU General Public License
    along with this program.  If not, see <https://www.gnu.org/licenses/>.  */
 
+#define _POSIX_C_SOURCE 200809L
+
 #include <getopt.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+
+// 64-bit words of grid cells processed together by the bitset engine
+#define VEC_WORDS 4
+
+typedef uint64_t word_vec __attribute__((vector_size(VEC_WORDS * sizeof(uint64_t))));
+typedef uint64_t word_vec_unaligned
+    __attribute__((vector_size(VEC_WORDS * sizeof(uint64_t)), aligned(8), may_alias));
+
+// VEC_WORDS words of a bit grid row starting at words
+#define LOAD_WORDS(words) (*(const word_vec_unaligned *)(words))
+// neighbors to the west of each cell, moved into the cell's bit position
+#define SHIFT_WEST(row, k) ((LOAD_WORDS((row) + (k)) << 1) | (LOAD_WORDS((row) + (k) - 1) >> 63))
+// neighbors to the east of each cell, moved into the cell's bit position
+#define SHIFT_EAST(row, k) ((LOAD_WORDS((row) + (k)) >> 1) | (LOAD_WORDS((row) + (k) + 1) << 63))
+
+enum neighborhood {
+    MOORE,       // the 8 surrounding cells
+    VON_NEUMANN, // the 4 orthogonally adjacent cells
+};
+
+// A roll is removed when fewer than threshold cells of its neighborhood are
+// rolls. Any character in cells is a roll; NULL means only '@'. Maps are
+// translated to '@' and '.' as they are read, so engines only see those.
+struct rule {
+    enum neighborhood neighborhood;
+    int threshold;
+    const char *cells;
+};
+
+// What --stats reports about one map. Engines record every pass that
+// removed rolls with stats_pass, timed from the previous one.
+struct stats {
+    size_t width;
+    size_t height;
+    double parse_seconds;
+    double solve_seconds;
+    long *pass_removed;
+    double *pass_seconds;
+    size_t passes;
+    size_t capacity;
+    double mark;
+    int failed;
+};
+
+struct config {
+    struct rule rule;
+    struct stats *stats;
+    int jobs;
+    int single_pass;
+    int streaming;
+};
+
+// three consecutive rows of a map read from a stream, each without its newline
+struct row_window {
+    char *rows[3];
+    size_t caps[3];
+    ssize_t lens[3];
+};
+
+// Map loaded into one buffer, row y starting at cells + y * stride. Rows
+// shorter than the widest one are padded with '.'.
+struct grid {
+    char *cells;
+    size_t width;
+    size_t height;
+    size_t stride;
+    size_t capacity;
+};
+
+// one pass of the scan engine, storing removable roll positions
+typedef size_t (*rule_pass_fn)(const struct grid *grid, size_t *removable, const struct rule *rule);
+
+// Map with one bit per cell. Cell x of a row is bit (x + 1) % 64 of word
+// (x + 1) / 64, so bit 0 of the first word is the left border. Each row has
+// a zero guard word on both sides and the grid has a zero row above and
+// below, so neighbor lookups never need bounds checks.
+struct bit_grid {
+    uint64_t *words;
+    size_t row_words;
+    size_t stride;
+    size_t height;
+};
+
+// state shared by the threads of the banded bitset engine
+struct band_sim {
+    struct bit_grid *grids;
+    pthread_mutex_t start_lock;
+    pthread_barrier_t barrier;
+    long *removed;
+    struct stats *stats;
+    int jobs;
+};
+
+// frontier cells claimed at a time by a thread of the frontier engine
+#define FRONTIER_CHUNK 1024
+
+// state shared by the threads of the frontier engine
+struct frontier_sim {
+    const struct grid *grid;
+    struct stats *stats;
+    atomic_uchar *nearby;
+    size_t *frontier;
+    size_t frontier_len;
+    size_t *next_frontier;
+    atomic_size_t cursor;
+    pthread_mutex_t start_lock;
+    pthread_barrier_t barrier;
+    struct frontier_worker *workers;
+    int jobs;
+    long total_removed;
+    atomic_int failed;
+};
+
+// a thread of the frontier engine and the cells it found for the next pass
+struct frontier_worker {
+    pthread_t thread;
+    struct frontier_sim *sim;
+    int id;
+    size_t *found;
+    size_t found_len;
+    size_t found_capacity;
+};
+
+// one horizontal band of rows [y_start, y_end)
+struct band {
+    pthread_t thread;
+    struct band_sim *sim;
+    int id;
+    size_t y_start;
+    size_t y_end;
+    long total_removed;
+};
 
 void usage(FILE *out, const char *prog) {
     fprintf(out,
@@ -29,39 +168,156 @@ void usage(FILE *out, const char *prog) {
         "With no FILE, read standard input.\n"
         "\n"
         "Options:\n"
-        "   -n, --number      Specify number of batteries to turn on in each bank (default: 12)\n"
+        "   -e, --engine=NAME Simulate removals with engine NAME: scan (default), bitset,\n"
+        "                     worklist, frontier, or stream to keep only three rows in\n"
+        "                     memory and spill each pass to a temporary file\n"
+        "   -N, --neighborhood=NAME\n"
+        "                     Count neighbors in neighborhood NAME: moore (default) for\n"
+        "                     all 8 surrounding cells, von-neumann for the 4 adjacent\n"
+        "   -t, --threshold=N Remove rolls with fewer than N neighboring rolls (default 4)\n"
+        "   -c, --cells=CHARS Treat every character in CHARS as a roll (default @)\n"
+        "                     Other neighborhoods and thresholds need the scan or stream\n"
+        "                     engine\n"
+        "   -s, --stats[=FORMAT]\n"
+        "                     Report the map size, parse time, rolls removed and time\n"
+        "                     taken by each pass on standard error, as text (default)\n"
+        "                     or one json object per FILE, then the peak memory of the\n"
+        "                     whole process once all FILEs are done\n"
+        "   -1, --single-pass Only count the rolls that can be removed right now, reading\n"
+        "                     three rows at a time\n"
+        "   -j, --jobs=N      Simulate on N threads: bands of rows for the bitset engine\n"
+        "                     (the default with N > 1), frontier chunks for frontier\n"
         "   -h, --help        Display this help and exit\n"
         "   -V, --version     Display version information and exit\n",
         prog
     );
 }
 
-void free_map(char** map, size_t map_height) {
-    for (size_t i = 0; i < map_height; i++) {
-        free(map[i]);
+// seconds on a monotonic clock
+double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// record a pass that removed rolls, if stats are being collected
+void stats_pass(struct stats *stats, long removed) {
+    if (stats == NULL || stats->failed) {
+        return;
+    }
+
+    // grow arrays if needed
+    if (stats->passes >= stats->capacity) {
+        size_t capacity = stats->capacity ? stats->capacity * 2 : 64;
+        long *new_removed = realloc(stats->pass_removed, capacity * sizeof(long));
+        if (new_removed) {
+            stats->pass_removed = new_removed;
+        }
+        double *new_seconds = realloc(stats->pass_seconds, capacity * sizeof(double));
+        if (new_seconds) {
+            stats->pass_seconds = new_seconds;
+        }
+        if (!new_removed || !new_seconds) {
+            stats->failed = 1;
+            return;
+        }
+        stats->capacity = capacity;
+    }
+
+    double t = now();
+    stats->pass_removed[stats->passes] = removed;
+    stats->pass_seconds[stats->passes] = t - stats->mark;
+    stats->passes++;
+    stats->mark = t;
+}
+
+// record how long solving took, returning -1 instead of total_removed if the
+// stats could not be kept
+long stats_finish(struct stats *stats, double solve_start, long total_removed) {
+    if (stats == NULL) {
+        return total_removed;
+    }
+
+    stats->solve_seconds = now() - solve_start;
+    if (stats->failed) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+    return total_removed;
+}
+
+void stats_free(struct stats *stats) {
+    free(stats->pass_removed);
+    free(stats->pass_seconds);
+    memset(stats, 0, sizeof(*stats));
+}
+
+void print_json_string(FILE *out, const char *str) {
+    fputc('"', out);
+    for (const unsigned char *c = (const unsigned char *)str; *c; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void print_stats(FILE *out, const char *name, const struct stats *stats, long answer, int json) {
+    if (json) {
+        fprintf(out, "{\"file\": ");
+        print_json_string(out, name);
+        fprintf(out, ", \"width\": %zu, \"height\": %zu, \"parse_seconds\": %.6f, "
+            "\"solve_seconds\": %.6f, \"removed\": %ld, \"passes\": %zu, \"pass_removed\": [",
+            stats->width, stats->height, stats->parse_seconds, stats->solve_seconds,
+            answer, stats->passes);
+        for (size_t i = 0; i < stats->passes; i++) {
+            fprintf(out, i ? ", %ld" : "%ld", stats->pass_removed[i]);
+        }
+        fprintf(out, "], \"pass_seconds\": [");
+        for (size_t i = 0; i < stats->passes; i++) {
+            fprintf(out, i ? ", %.6f" : "%.6f", stats->pass_seconds[i]);
+        }
+        fprintf(out, "]}\n");
+        return;
+    }
+
+    fprintf(out, "%s: %zux%zu map, parsed in %.6f s\n", name, stats->width, stats->height, stats->parse_seconds);
+    for (size_t i = 0; i < stats->passes; i++) {
+        fprintf(out, "  pass %zu: removed %ld in %.6f s\n", i + 1, stats->pass_removed[i], stats->pass_seconds[i]);
     }
-    free(map);
+    fprintf(out, "%s: removed %ld in %zu passes, %.6f s\n", name, answer, stats->passes, stats->solve_seconds);
 }
 
-void free_arr(int* arr, size_t len) {
-    for (size_t i = 0; i < len; i++) {
-        free(arr[i]);
+// the high-water mark covers every FILE solved so far, so it is only
+// reported once for the whole process
+void print_peak_memory(FILE *out, int json) {
+    struct rusage usage;
+    long peak_kib = getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : -1;
+
+    if (json) {
+        fprintf(out, "{\"process_peak_memory_kib\": %ld}\n", peak_kib);
+    } else {
+        fprintf(out, "process peak memory %ld KiB\n", peak_kib);
     }
-    free(arr);
 }
 
-int count_nearby_rolls(char** map, int x, int y, size_t map_width, size_t map_height) {
+int count_nearby_rolls(const struct grid *grid, int x, int y) {
     int upper_bound = y - 1 < 0 ? 0 : y - 1;
-    int lower_bound = y + 1 > map_height - 1 ? map_height - 1 : y + 1;
+    int lower_bound = y + 1 > (int)grid->height - 1 ? (int)grid->height - 1 : y + 1;
     int left_bound = x - 1 < 0 ? 0 : x - 1;
-    int right_bound = x + 1 > map_width - 1 ? map_width - 1 : x + 1;
+    int right_bound = x + 1 > (int)grid->width - 1 ? (int)grid->width - 1 : x + 1;
 
     int count = 0;
     for (int j = upper_bound; j <= lower_bound; j++) {
+        const char *row = grid->cells + j * grid->stride;
         for (int i = left_bound; i <= right_bound; i++) {
             if (j == y && i == x) continue;
 
-            if (map[j][i] == '@') {
+            if (row[i] == '@') {
                 count++;
             }
         }
@@ -70,115 +326,951 @@ int count_nearby_rolls(char** map, int x, int y, size_t map_width, size_t map_he
     return count;
 }
 
-long solve(FILE *input) {
-    size_t capacity = 16;
-    size_t map_width = 0;
-    size_t map_height = 0;
+// Find every roll with fewer than threshold rolls in its neighborhood,
+// storing their positions in removable. Inlined into the kernels below so
+// that constant rules fold into the loop.
+static inline __attribute__((always_inline))
+size_t rule_pass(const struct grid *grid, size_t *removable, enum neighborhood neighborhood, int threshold) {
+    size_t removable_len = 0;
+
+    for (size_t y = 0; y < grid->height; y++) {
+        const char *row = grid->cells + y * grid->stride;
+        const char *above = y > 0 ? row - grid->stride : NULL;
+        const char *below = y + 1 < grid->height ? row + grid->stride : NULL;
+
+        for (size_t x = 0; x < grid->width; x++) {
+            if (row[x] != '@') {
+                continue;
+            }
+
+            int west = x > 0;
+            int east = x + 1 < grid->width;
+            int nearby = (west && row[x - 1] == '@') + (east && row[x + 1] == '@');
+
+            if (above) {
+                nearby += above[x] == '@';
+                if (neighborhood == MOORE) {
+                    nearby += (west && above[x - 1] == '@') + (east && above[x + 1] == '@');
+                }
+            }
+            if (below) {
+                nearby += below[x] == '@';
+                if (neighborhood == MOORE) {
+                    nearby += (west && below[x - 1] == '@') + (east && below[x + 1] == '@');
+                }
+            }
+
+            if (nearby < threshold) {
+                removable[removable_len++] = y * grid->stride + x;
+            }
+        }
+    }
+
+    return removable_len;
+}
+
+// a pass specialized for one neighborhood and threshold
+#define RULE_KERNEL(name, neighborhood, threshold)                                   \
+    size_t name(const struct grid *grid, size_t *removable, const struct rule *rule) { \
+        (void)rule;                                                                  \
+        return rule_pass(grid, removable, neighborhood, threshold);                  \
+    }
+
+RULE_KERNEL(rule_pass_moore_3, MOORE, 3)
+RULE_KERNEL(rule_pass_moore_4, MOORE, 4)
+RULE_KERNEL(rule_pass_moore_5, MOORE, 5)
+RULE_KERNEL(rule_pass_von_neumann_2, VON_NEUMANN, 2)
+RULE_KERNEL(rule_pass_von_neumann_3, VON_NEUMANN, 3)
+
+size_t rule_pass_generic(const struct grid *grid, size_t *removable, const struct rule *rule) {
+    return rule_pass(grid, removable, rule->neighborhood, rule->threshold);
+}
+
+// the specialized pass for rule, or the generic one if there is none
+rule_pass_fn rule_kernel(const struct rule *rule) {
+    static const struct {
+        enum neighborhood neighborhood;
+        int threshold;
+        rule_pass_fn pass;
+    } kernels[] = {
+        {MOORE, 3, rule_pass_moore_3},
+        {MOORE, 4, rule_pass_moore_4},
+        {MOORE, 5, rule_pass_moore_5},
+        {VON_NEUMANN, 2, rule_pass_von_neumann_2},
+        {VON_NEUMANN, 3, rule_pass_von_neumann_3},
+    };
+
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) {
+        if (kernels[i].neighborhood == rule->neighborhood && kernels[i].threshold == rule->threshold) {
+            return kernels[i].pass;
+        }
+    }
+
+    return rule_pass_generic;
+}
 
-    // initialize an array containing all of the lines of input (representing the map)
-    char** map = malloc(capacity * sizeof(char*));
-    if (map == NULL) {
+// translate a row of the map to '@' for rolls and '.' for everything else
+void rule_translate(const struct rule *rule, char *row, size_t len) {
+    if (rule->cells == NULL) {
+        return;
+    }
+
+    for (size_t x = 0; x < len; x++) {
+        row[x] = row[x] != '\0' && strchr(rule->cells, row[x]) ? '@' : '.';
+    }
+}
+
+// remove rolls pass by pass by checking the neighbors of every cell
+long remove_rolls_scan(struct grid *grid, const struct config *config) {
+    long total_removed = 0;
+    rule_pass_fn pass = rule_kernel(&config->rule);
+
+    // positions of the rolls to remove after each pass, reused by every pass
+    size_t *removable = malloc((grid->width * grid->height + 1) * sizeof(size_t));
+    if (!removable) {
         fprintf(stderr, "memory allocation failed\n");
         return -1;
     }
 
-    char* line = NULL;
-    size_t linecap = 0;
-    int linelen;
+    while (1) {
+        // check current map for removable rolls
+        size_t removable_len = pass(grid, removable, &config->rule);
 
-    // fill map
-    while ((linelen = getline(&line, &linecap, input)) != -1) {
-        // remove \n character from line
-        if (linelen > 0 && line[linelen - 1] == '\n') {
-            line[linelen - 1] = '\0';
-            linelen--;
+        // remove rolls
+        for (size_t p = 0; p < removable_len; p++) {
+            grid->cells[removable[p]] = '.';
         }
 
-        // grow array if needed
-        if (map_height >= capacity) {
-            capacity *= 2;
-            char** new_map = realloc(map, capacity * sizeof(char*));
-            if (map == NULL) {
-                free_map(map, map_height);
-                return -1;
+        total_removed += removable_len;
+
+        if (removable_len == 0) {
+            break;
+        }
+        stats_pass(config->stats, removable_len);
+    }
+
+    free(removable);
+    return total_removed;
+}
+
+uint64_t *bit_grid_row(const struct bit_grid *grid, size_t y) {
+    // skip the zero row on top and the left guard word
+    return grid->words + (y + 1) * grid->stride + 1;
+}
+
+int bit_grid_init(struct bit_grid *grid, size_t map_width, size_t map_height) {
+    // round up so every row is a whole number of vectors
+    grid->row_words = (map_width + 2 + 63) / 64;
+    grid->row_words = (grid->row_words + VEC_WORDS - 1) / VEC_WORDS * VEC_WORDS;
+    grid->stride = grid->row_words + 2;
+    grid->height = map_height;
+
+    grid->words = calloc(grid->stride * (map_height + 2), sizeof(uint64_t));
+    if (!grid->words) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Remove one pass of rolls in rows [y_start, y_end) from cur into next and
+// return how many were removed. The eight neighbor masks of 256 cells are
+// added with bit-sliced adders that only keep track of whether the count
+// reached 4. Rows just outside the range are only read.
+long bit_grid_pass(const struct bit_grid *cur, struct bit_grid *next, size_t y_start, size_t y_end) {
+    long removed = 0;
+
+    for (size_t y = y_start; y < y_end; y++) {
+        const uint64_t *rows[3] = {
+            bit_grid_row(cur, y) - cur->stride,
+            bit_grid_row(cur, y),
+            bit_grid_row(cur, y) + cur->stride
+        };
+        uint64_t *out = bit_grid_row(next, y);
+
+        for (size_t k = 0; k < cur->row_words; k += VEC_WORDS) {
+            word_vec self = LOAD_WORDS(rows[1] + k);
+
+            word_vec a = SHIFT_WEST(rows[0], k), b = LOAD_WORDS(rows[0] + k), c = SHIFT_EAST(rows[0], k);
+            word_vec d = SHIFT_WEST(rows[1], k), e = SHIFT_EAST(rows[1], k);
+            word_vec f = SHIFT_WEST(rows[2], k), g = LOAD_WORDS(rows[2] + k), h = SHIFT_EAST(rows[2], k);
+
+            // ones: two full adders and a half adder, then a full adder of their sums
+            word_vec s1 = a ^ b ^ c, c1 = (a & b) | (c & (a ^ b));
+            word_vec s2 = d ^ e ^ f, c2 = (d & e) | (f & (d ^ e));
+            word_vec s3 = g ^ h, c3 = g & h;
+            word_vec c4 = (s1 & s2) | (s3 & (s1 ^ s2));
+
+            // twos: the count is at least 4 when at least two of c1..c4 are set
+            word_vec at_least_4 = ((c1 & c2) | (c3 & (c1 ^ c2))) | ((c1 ^ c2 ^ c3) & c4);
+
+            word_vec kept = self & at_least_4;
+            word_vec gone = self & ~at_least_4;
+            *(word_vec_unaligned *)(out + k) = kept;
+
+            for (int i = 0; i < VEC_WORDS; i++) {
+                removed += __builtin_popcountll(gone[i]);
             }
-            map = new_map;
         }
+    }
 
-        char* map_line = malloc((linelen + 1) * sizeof(char));
-        if (map_line == NULL) {
-            fprintf(stderr, "memory allocation failed\n");
-            return -1;
+    return removed;
+}
+
+// Run passes on one band until a pass removes nothing anywhere. The halo
+// rows above and below the band belong to the neighboring bands and are only
+// read, and every pass ends at a barrier so that all removals of a pass
+// happen at once.
+void *run_band(void *arg) {
+    struct band *band = arg;
+    struct band_sim *sim = band->sim;
+    int cur = 0;
+
+    // wait until every band has its rows
+    pthread_mutex_lock(&sim->start_lock);
+    pthread_mutex_unlock(&sim->start_lock);
+
+    while (1) {
+        sim->removed[band->id] = bit_grid_pass(&sim->grids[cur], &sim->grids[1 - cur],
+            band->y_start, band->y_end);
+        pthread_barrier_wait(&sim->barrier);
+
+        // every band sums the same counts in the same order
+        long removed = 0;
+        for (int i = 0; i < sim->jobs; i++) {
+            removed += sim->removed[i];
+        }
+        band->total_removed += sim->removed[band->id];
+        if (band->id == 0 && removed > 0) {
+            stats_pass(sim->stats, removed);
+        }
+
+        // nobody may overwrite a count before every band has read them
+        pthread_barrier_wait(&sim->barrier);
+
+        if (removed == 0) {
+            break;
+        }
+        cur = 1 - cur;
+    }
+
+    return NULL;
+}
+
+// run the bitset passes on jobs threads, one band of rows each
+long run_bands(struct bit_grid *grids, int jobs, struct stats *stats) {
+    if ((size_t)jobs > grids[0].height) {
+        jobs = grids[0].height > 0 ? grids[0].height : 1;
+    }
+
+    struct band_sim sim = { .grids = grids, .stats = stats, .jobs = jobs };
+    struct band *bands = calloc(jobs, sizeof(struct band));
+    sim.removed = calloc(jobs, sizeof(long));
+    if (!bands || !sim.removed) {
+        free(bands);
+        free(sim.removed);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        bands[i].sim = &sim;
+        bands[i].id = i;
+    }
+
+    // threads hold at the start lock until the number of bands is settled,
+    // so a thread that fails to start only means fewer, wider bands
+    pthread_mutex_init(&sim.start_lock, NULL);
+    pthread_mutex_lock(&sim.start_lock);
+
+    int started = 1;
+    for (; started < jobs; started++) {
+        if (pthread_create(&bands[started].thread, NULL, run_band, &bands[started]) != 0) {
+            fprintf(stderr, "failed to start thread\n");
+            break;
+        }
+    }
+    jobs = sim.jobs = started;
+
+    size_t height = grids[0].height;
+    for (int i = 0; i < jobs; i++) {
+        bands[i].y_start = height * i / jobs;
+        bands[i].y_end = height * (i + 1) / jobs;
+    }
+
+    pthread_barrier_init(&sim.barrier, NULL, jobs);
+    pthread_mutex_unlock(&sim.start_lock);
+
+    run_band(&bands[0]);
+
+    long total_removed = bands[0].total_removed;
+    for (int i = 1; i < jobs; i++) {
+        pthread_join(bands[i].thread, NULL);
+        total_removed += bands[i].total_removed;
+    }
+
+    pthread_barrier_destroy(&sim.barrier);
+    pthread_mutex_destroy(&sim.start_lock);
+    free(bands);
+    free(sim.removed);
+    return total_removed;
+}
+
+// remove rolls pass by pass on a bit-packed copy of the map
+long remove_rolls_bitset(struct grid *grid, const struct config *config) {
+    struct bit_grid grids[2];
+
+    if (bit_grid_init(&grids[0], grid->width, grid->height) != 0) {
+        return -1;
+    }
+    if (bit_grid_init(&grids[1], grid->width, grid->height) != 0) {
+        free(grids[0].words);
+        return -1;
+    }
+
+    for (size_t y = 0; y < grid->height; y++) {
+        uint64_t *row = bit_grid_row(&grids[0], y);
+        const char *cells = grid->cells + y * grid->stride;
+        for (size_t x = 0; x < grid->width; x++) {
+            if (cells[x] == '@') {
+                row[(x + 1) / 64] |= 1UL << ((x + 1) % 64);
+            }
         }
-        strcpy(map_line, line);
-        map[map_height] = map_line;
-        
-        map_height++;
-        map_width = linelen > map_width ? linelen : map_width;
     }
 
     long total_removed = 0;
+    long removed;
+    int cur = 0;
 
-    while (1) {
-        // initialize array of roll positions to remove after this pass
-        int** removable_roll_pos = malloc(map_width * map_height * sizeof(int*));
-        int removable_len = 0;
-        if (!removable_roll_pos) {
-            fprintf(stderr, "memory allocation failed");
+    if (config->jobs > 1) {
+        total_removed = run_bands(grids, config->jobs, config->stats);
+    } else {
+        while ((removed = bit_grid_pass(&grids[cur], &grids[1 - cur], 0, grid->height)) > 0) {
+            stats_pass(config->stats, removed);
+            total_removed += removed;
+            cur = 1 - cur;
+        }
+    }
+
+    free(grids[0].words);
+    free(grids[1].words);
+    return total_removed;
+}
+
+// Remove rolls by peeling: every roll's neighbor count is computed once, and
+// removing a roll decrements its neighbors, queueing any that drop below 4.
+// Rolls are queued in the order they become removable, so the queue holds
+// the rolls of one pass before those of the next.
+long remove_rolls_worklist(struct grid *grid, const struct config *config) {
+    enum { EMPTY, ROLL, QUEUED };
+    size_t map_width = grid->width;
+    size_t map_height = grid->height;
+    size_t cells = map_width * map_height;
+
+    unsigned char *state = calloc(cells + 1, 1);
+    unsigned char *nearby = calloc(cells + 1, 1);
+    size_t *queue = malloc((cells + 1) * sizeof(size_t));
+    if (!state || !nearby || !queue) {
+        free(state);
+        free(nearby);
+        free(queue);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    for (size_t y = 0; y < map_height; y++) {
+        const char *row = grid->cells + y * grid->stride;
+        for (size_t x = 0; x < map_width; x++) {
+            if (row[x] == '@') {
+                state[y * map_width + x] = ROLL;
+            }
+        }
+    }
+
+    size_t head = 0;
+    size_t tail = 0;
+
+    for (size_t y = 0; y < map_height; y++) {
+        for (size_t x = 0; x < map_width; x++) {
+            size_t i = y * map_width + x;
+            if (state[i] != ROLL) {
+                continue;
+            }
+
+            for (size_t ny = y > 0 ? y - 1 : 0; ny <= y + 1 && ny < map_height; ny++) {
+                for (size_t nx = x > 0 ? x - 1 : 0; nx <= x + 1 && nx < map_width; nx++) {
+                    if ((ny != y || nx != x) && state[ny * map_width + nx] != EMPTY) {
+                        nearby[i]++;
+                    }
+                }
+            }
+
+            if (nearby[i] < 4) {
+                state[i] = QUEUED;
+                queue[tail++] = i;
+            }
+        }
+    }
+
+    // the queue holds every roll of a pass before the ones of the next
+    size_t pass_start = 0;
+    size_t pass_end = tail;
+
+    while (head < tail) {
+        if (head == pass_end) {
+            stats_pass(config->stats, pass_end - pass_start);
+            pass_start = pass_end;
+            pass_end = tail;
+        }
+        size_t i = queue[head++];
+        size_t y = i / map_width;
+        size_t x = i % map_width;
+
+        for (size_t ny = y > 0 ? y - 1 : 0; ny <= y + 1 && ny < map_height; ny++) {
+            for (size_t nx = x > 0 ? x - 1 : 0; nx <= x + 1 && nx < map_width; nx++) {
+                size_t j = ny * map_width + nx;
+                if (state[j] == ROLL && --nearby[j] < 4) {
+                    state[j] = QUEUED;
+                    queue[tail++] = j;
+                }
+            }
+        }
+    }
+
+    if (tail > pass_start) {
+        stats_pass(config->stats, tail - pass_start);
+    }
+
+    // every queued roll was removed
+    long total_removed = tail;
+
+    free(state);
+    free(nearby);
+    free(queue);
+    return total_removed;
+}
+
+int frontier_push(struct frontier_worker *worker, size_t cell) {
+    // grow array if needed
+    if (worker->found_len >= worker->found_capacity) {
+        size_t capacity = worker->found_capacity ? worker->found_capacity * 2 : FRONTIER_CHUNK;
+        size_t *new_found = realloc(worker->found, capacity * sizeof(size_t));
+        if (!new_found) {
             return -1;
         }
+        worker->found = new_found;
+        worker->found_capacity = capacity;
+    }
 
-        // check current map for removable rolls
-        for (size_t y = 0; y < map_height; y++) {
-            for (size_t x = 0; x < map_width; x++) {
-                if (map[y][x] == '@') {
-                    int nearby = count_nearby_rolls(map, x, y, map_width, map_height);
-                    if (nearby < 4) {
-                        int* pos = malloc(2 * sizeof(int));
-                        pos[0] = x;
-                        pos[1] = y;
-                        removable_roll_pos[removable_len] = pos;
-                        removable_len++;
+    worker->found[worker->found_len++] = cell;
+    return 0;
+}
+
+// Remove the current frontier in parallel, pass by pass. Removing a roll
+// atomically decrements its roll neighbors, and the thread that takes a
+// neighbor from 4 down to 3 owns it for the next frontier, so every roll
+// enters a frontier exactly once and in the pass where the scan engine would
+// remove it.
+void *run_frontier(void *arg) {
+    struct frontier_worker *worker = arg;
+    struct frontier_sim *sim = worker->sim;
+    const struct grid *grid = sim->grid;
+
+    // wait until the number of workers is settled
+    pthread_mutex_lock(&sim->start_lock);
+    pthread_mutex_unlock(&sim->start_lock);
+
+    while (sim->frontier_len > 0) {
+        size_t start;
+        worker->found_len = 0;
+
+        while ((start = atomic_fetch_add(&sim->cursor, FRONTIER_CHUNK)) < sim->frontier_len) {
+            size_t end = start + FRONTIER_CHUNK < sim->frontier_len ? start + FRONTIER_CHUNK : sim->frontier_len;
+
+            for (size_t f = start; f < end; f++) {
+                size_t y = sim->frontier[f] / grid->stride;
+                size_t x = sim->frontier[f] % grid->stride;
+
+                for (size_t ny = y > 0 ? y - 1 : 0; ny <= y + 1 && ny < grid->height; ny++) {
+                    for (size_t nx = x > 0 ? x - 1 : 0; nx <= x + 1 && nx < grid->width; nx++) {
+                        size_t j = ny * grid->stride + nx;
+                        if (grid->cells[j] != '@' || (ny == y && nx == x)) {
+                            continue;
+                        }
+                        if (atomic_fetch_sub_explicit(&sim->nearby[j], 1, memory_order_relaxed) == 4
+                                && frontier_push(worker, j) != 0) {
+                            atomic_store(&sim->failed, 1);
+                        }
                     }
                 }
             }
-        };
+        }
+        pthread_barrier_wait(&sim->barrier);
 
-        // remove rolls
-        for (int p = 0; p < removable_len; p++) {
-            int* pos = removable_roll_pos[p];
-            map[pos[1]][pos[0]] = '.';
+        // concatenate the found cells in worker order into the next frontier
+        size_t offset = 0;
+        for (int i = 0; i < worker->id; i++) {
+            offset += sim->workers[i].found_len;
+        }
+        // found stays NULL until the worker pushes its first cell
+        if (worker->found_len > 0) {
+            memcpy(sim->next_frontier + offset, worker->found, worker->found_len * sizeof(size_t));
         }
+        pthread_barrier_wait(&sim->barrier);
 
-        total_removed += removable_len;
-        free(removable_roll_pos);
+        if (worker->id == 0) {
+            size_t next_len = 0;
+            for (int i = 0; i < sim->jobs; i++) {
+                next_len += sim->workers[i].found_len;
+            }
 
-        if (removable_len == 0) {
+            size_t *tmp = sim->frontier;
+            sim->frontier = sim->next_frontier;
+            sim->next_frontier = tmp;
+            stats_pass(sim->stats, sim->frontier_len);
+            sim->total_removed += sim->frontier_len;
+            sim->frontier_len = next_len;
+            atomic_store(&sim->cursor, 0);
+        }
+        pthread_barrier_wait(&sim->barrier);
+    }
+
+    return NULL;
+}
+
+// remove rolls a frontier at a time on jobs threads
+long remove_rolls_frontier(struct grid *grid, const struct config *config) {
+    size_t cells = grid->height * grid->stride;
+    struct frontier_sim sim = { .grid = grid, .stats = config->stats };
+    int jobs = config->jobs;
+
+    sim.nearby = malloc((cells + 1) * sizeof(atomic_uchar));
+    sim.frontier = malloc((cells + 1) * sizeof(size_t));
+    sim.next_frontier = malloc((cells + 1) * sizeof(size_t));
+    sim.workers = calloc(jobs, sizeof(struct frontier_worker));
+    if (!sim.nearby || !sim.frontier || !sim.next_frontier || !sim.workers) {
+        free(sim.nearby);
+        free(sim.frontier);
+        free(sim.next_frontier);
+        free(sim.workers);
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    // the first frontier is every roll with fewer than 4 neighbors
+    for (size_t y = 0; y < grid->height; y++) {
+        for (size_t x = 0; x < grid->width; x++) {
+            size_t i = y * grid->stride + x;
+            if (grid->cells[i] != '@') {
+                continue;
+            }
+
+            int nearby = count_nearby_rolls(grid, x, y);
+            atomic_init(&sim.nearby[i], nearby);
+            if (nearby < 4) {
+                sim.frontier[sim.frontier_len++] = i;
+            }
+        }
+    }
+
+    atomic_init(&sim.cursor, 0);
+    atomic_init(&sim.failed, 0);
+
+    for (int i = 0; i < jobs; i++) {
+        sim.workers[i].sim = &sim;
+        sim.workers[i].id = i;
+    }
+
+    // threads hold at the start lock until the number of workers is settled
+    pthread_mutex_init(&sim.start_lock, NULL);
+    pthread_mutex_lock(&sim.start_lock);
+
+    int started = 1;
+    for (; started < jobs; started++) {
+        if (pthread_create(&sim.workers[started].thread, NULL, run_frontier, &sim.workers[started]) != 0) {
+            fprintf(stderr, "failed to start thread\n");
+            break;
+        }
+    }
+    sim.jobs = started;
+
+    pthread_barrier_init(&sim.barrier, NULL, sim.jobs);
+    pthread_mutex_unlock(&sim.start_lock);
+
+    run_frontier(&sim.workers[0]);
+
+    for (int i = 1; i < sim.jobs; i++) {
+        pthread_join(sim.workers[i].thread, NULL);
+    }
+    for (int i = 0; i < sim.jobs; i++) {
+        free(sim.workers[i].found);
+    }
+
+    pthread_barrier_destroy(&sim.barrier);
+    pthread_mutex_destroy(&sim.start_lock);
+    free(sim.nearby);
+    free(sim.frontier);
+    free(sim.next_frontier);
+    free(sim.workers);
+
+    if (atomic_load(&sim.failed)) {
+        fprintf(stderr, "memory allocation failed\n");
+        return -1;
+    }
+
+    return sim.total_removed;
+}
+
+// read the next row into the last slot of the window, -1 at end of input
+ssize_t row_window_read(struct row_window *window, FILE *input, const struct rule *rule) {
+    ssize_t linelen = getline(&window->rows[2], &window->caps[2], input);
+
+    // remove \n character from line
+    if (linelen > 0 && window->rows[2][linelen - 1] == '\n') {
+        linelen--;
+    }
+
+    if (linelen > 0) {
+        rule_translate(rule, window->rows[2], linelen);
+    }
+
+    window->lens[2] = linelen;
+    return linelen;
+}
+
+// move every row up one slot, recycling the buffer of the first row
+void row_window_shift(struct row_window *window) {
+    char *row = window->rows[0];
+    size_t cap = window->caps[0];
+
+    for (int i = 0; i < 2; i++) {
+        window->rows[i] = window->rows[i + 1];
+        window->caps[i] = window->caps[i + 1];
+        window->lens[i] = window->lens[i + 1];
+    }
+
+    window->rows[2] = row;
+    window->caps[2] = cap;
+    window->lens[2] = -1;
+}
+
+int window_is_roll(const struct row_window *window, int r, ssize_t x) {
+    return x >= 0 && x < window->lens[r] && window->rows[r][x] == '@';
+}
+
+// Run one removal pass over the map in input, keeping only the rows above and
+// below the current one. Writes the map after the pass to output unless it
+// is NULL, records the map size in stats unless it is NULL, and returns how
+// many rolls were removed.
+long stream_pass(FILE *input, FILE *output, const struct rule *rule, struct stats *stats) {
+    struct row_window window = { .lens = { -1, -1, -1 } };
+    char *out_row = NULL;
+    size_t out_cap = 0;
+    long removed = 0;
+    size_t width = 0;
+    size_t height = 0;
+
+    row_window_read(&window, input, rule);
+    row_window_shift(&window);
+    if (window.lens[1] != -1) {
+        row_window_read(&window, input, rule);
+    }
+
+    while (window.lens[1] != -1) {
+        const char *row = window.rows[1];
+        size_t len = window.lens[1];
+
+        width = len > width ? len : width;
+        height++;
+
+        // the window keeps the rows as they were before this pass
+        if (output && len > out_cap) {
+            char *new_out_row = realloc(out_row, len);
+            if (!new_out_row) {
+                fprintf(stderr, "realloc failed\n");
+                removed = -1;
+                break;
+            }
+            out_row = new_out_row;
+            out_cap = len;
+        }
+
+        for (ssize_t x = 0; x < (ssize_t)len; x++) {
+            char cell = row[x];
+
+            if (cell == '@') {
+                int nearby = 0;
+                for (int r = 0; r < 3; r++) {
+                    for (ssize_t nx = x - 1; nx <= x + 1; nx++) {
+                        if (rule->neighborhood == VON_NEUMANN && r != 1 && nx != x) {
+                            continue;
+                        }
+                        if ((r != 1 || nx != x) && window_is_roll(&window, r, nx)) {
+                            nearby++;
+                        }
+                    }
+                }
+
+                if (nearby < rule->threshold) {
+                    cell = '.';
+                    removed++;
+                }
+            }
+
+            if (output) {
+                out_row[x] = cell;
+            }
+        }
+
+        if (output && (fwrite(out_row, 1, len, output) != len || fputc('\n', output) == EOF)) {
+            fprintf(stderr, "error writing temporary file\n");
+            removed = -1;
+            break;
+        }
+
+        row_window_shift(&window);
+        if (window.lens[1] != -1) {
+            row_window_read(&window, input, rule);
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        free(window.rows[i]);
+    }
+    free(out_row);
+
+    if (stats) {
+        stats->width = width;
+        stats->height = height;
+    }
+    return removed;
+}
+
+// remove rolls pass by pass without loading the map, spilling the map after
+// each pass to a temporary file that the next pass reads back
+long remove_rolls_stream(FILE *input, const struct rule *rule, struct stats *stats) {
+    long total_removed = 0;
+    long removed;
+    FILE *pass_input = input;
+    struct rule pass_rule = *rule;
+
+    do {
+        FILE *pass_output = tmpfile();
+        if (pass_output == NULL) {
+            fprintf(stderr, "error creating temporary file\n");
+            removed = -1;
             break;
         }
+
+        removed = stream_pass(pass_input, pass_output, &pass_rule, stats);
+        if (pass_input != input) {
+            fclose(pass_input);
+        }
+        pass_input = pass_output;
+        rewind(pass_input);
+
+        // the temporary files hold maps already translated to '@' and '.'
+        pass_rule.cells = NULL;
+
+        if (removed > 0) {
+            stats_pass(stats, removed);
+        }
+        total_removed += removed;
+    } while (removed > 0);
+
+    if (pass_input != input) {
+        fclose(pass_input);
+    }
+
+    return removed == -1 ? -1 : total_removed;
+}
+
+// append a row to the grid, widening every earlier row if it is the widest yet
+int grid_append_row(struct grid *grid, const char *line, size_t linelen) {
+    size_t width = linelen > grid->width ? linelen : grid->width;
+    size_t needed = (grid->height + 1) * width;
+
+    // grow buffer if needed
+    if (needed > grid->capacity) {
+        size_t capacity = grid->capacity ? grid->capacity : 1024;
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        char *new_cells = realloc(grid->cells, capacity);
+        if (!new_cells) {
+            fprintf(stderr, "realloc failed\n");
+            return -1;
+        }
+        grid->cells = new_cells;
+        grid->capacity = capacity;
+    }
+
+    // restride existing rows from the last one down so none is overwritten
+    if (width > grid->width) {
+        for (size_t y = grid->height; y-- > 0;) {
+            memmove(grid->cells + y * width, grid->cells + y * grid->stride, grid->width);
+            memset(grid->cells + y * width + grid->width, '.', width - grid->width);
+        }
+        grid->width = width;
+        grid->stride = width;
+    }
+
+    char *row = grid->cells + grid->height * grid->stride;
+    memcpy(row, line, linelen);
+    memset(row + linelen, '.', grid->width - linelen);
+    grid->height++;
+    return 0;
+}
+
+long solve(FILE *input, long (*engine)(struct grid *, const struct config *),
+           const struct config *config) {
+    struct grid grid = {0};
+    struct stats *stats = config->stats;
+    double start = now();
+    double solve_start = start;
+    long total_removed;
+
+    if (stats) {
+        stats->mark = start;
+    }
+
+    if (config->single_pass) {
+        total_removed = stream_pass(input, NULL, &config->rule, stats);
+        if (total_removed > 0) {
+            stats_pass(stats, total_removed);
+        }
+        return stats_finish(stats, solve_start, total_removed);
+    }
+    if (config->streaming) {
+        total_removed = remove_rolls_stream(input, &config->rule, stats);
+        return stats_finish(stats, solve_start, total_removed);
+    }
+
+    char* line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
+
+    // fill map
+    while ((linelen = getline(&line, &linecap, input)) != -1) {
+        // remove \n character from line
+        if (linelen > 0 && line[linelen - 1] == '\n') {
+            linelen--;
+        }
+        rule_translate(&config->rule, line, linelen);
+
+        if (grid_append_row(&grid, line, linelen) != 0) {
+            free(line);
+            free(grid.cells);
+            return -1;
+        }
     }
 
     free(line);
-    free_map(map, map_height);
 
-    return total_removed;
+    if (stats) {
+        solve_start = now();
+        stats->width = grid.width;
+        stats->height = grid.height;
+        stats->parse_seconds = solve_start - start;
+        stats->mark = solve_start;
+    }
+
+    total_removed = engine(&grid, config);
+
+    free(grid.cells);
+
+    return stats_finish(stats, solve_start, total_removed);
 }
 
 int main(int argc, char **argv) {
     const char *prog = argv[0];
 
     static struct option long_opts[] = {
+        {"engine", required_argument, 0, 'e'},
+        {"jobs", required_argument, 0, 'j'},
+        {"neighborhood", required_argument, 0, 'N'},
+        {"threshold", required_argument, 0, 't'},
+        {"cells", required_argument, 0, 'c'},
+        {"stats", optional_argument, 0, 's'},
+        {"single-pass", no_argument, 0, '1'},
         {"help", no_argument, 0, 'h'},
-        {"version", no_argument, 0, 'V'}
+        {"version", no_argument, 0, 'V'},
+        {0, 0, 0, 0}
     };
 
     int opt;
     int opt_index = 0;
+    long (*engine)(struct grid *, const struct config *) = NULL;
+    struct config config = { .rule = { MOORE, 4, NULL }, .jobs = 1 };
+    struct stats stats = {0};
+    int stats_json = 0;
 
-    const char *short_opts = "hV";
+    const char *short_opts = "e:N:t:c:s::j:1hV";
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index)) != -1) {
         switch (opt) {
+            case 'e':
+                if (strcmp(optarg, "scan") == 0) {
+                    engine = remove_rolls_scan;
+                } else if (strcmp(optarg, "bitset") == 0) {
+                    engine = remove_rolls_bitset;
+                } else if (strcmp(optarg, "worklist") == 0) {
+                    engine = remove_rolls_worklist;
+                } else if (strcmp(optarg, "frontier") == 0) {
+                    engine = remove_rolls_frontier;
+                } else if (strcmp(optarg, "stream") == 0) {
+                    // reads the input itself instead of a loaded grid
+                    config.streaming = 1;
+                } else {
+                    fprintf(stderr, "unknown engine: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'N':
+                if (strcmp(optarg, "moore") == 0) {
+                    config.rule.neighborhood = MOORE;
+                } else if (strcmp(optarg, "von-neumann") == 0) {
+                    config.rule.neighborhood = VON_NEUMANN;
+                } else {
+                    fprintf(stderr, "unknown neighborhood: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                config.rule.threshold = atoi(optarg);
+                if (config.rule.threshold < 1 || config.rule.threshold > 9) {
+                    fprintf(stderr, "invalid threshold: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'c':
+                if (optarg[0] == '\0') {
+                    fprintf(stderr, "no roll characters given\n");
+                    return EXIT_FAILURE;
+                }
+                config.rule.cells = optarg;
+                break;
+            case 's':
+                if (optarg == NULL || strcmp(optarg, "text") == 0) {
+                    stats_json = 0;
+                } else if (strcmp(optarg, "json") == 0) {
+                    stats_json = 1;
+                } else {
+                    fprintf(stderr, "unknown stats format: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                config.stats = &stats;
+                break;
+            case '1':
+                config.single_pass = 1;
+                break;
+            case 'j':
+                config.jobs = atoi(optarg);
+                if (config.jobs < 1) {
+                    fprintf(stderr, "invalid number of jobs: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
             case 'h':
                 usage(stdout, prog);
                 return EXIT_SUCCESS;
@@ -191,12 +1283,32 @@ int main(int argc, char **argv) {
         }
     }
 
+    if (engine == NULL && !config.streaming) {
+        engine = config.jobs > 1 ? remove_rolls_bitset : remove_rolls_scan;
+    }
+
+    if (config.jobs > 1 && engine != remove_rolls_bitset && engine != remove_rolls_frontier) {
+        fprintf(stderr, "--jobs is only supported by the bitset and frontier engines\n");
+        return EXIT_FAILURE;
+    }
+
+    if ((config.rule.neighborhood != MOORE || config.rule.threshold != 4)
+            && engine != remove_rolls_scan && !config.streaming && !config.single_pass) {
+        fprintf(stderr, "--neighborhood and --threshold are only supported by the scan and stream engines\n");
+        return EXIT_FAILURE;
+    }
+
     if (optind == argc) {
         long answer;
-        if ((answer = solve(stdin)) == -1) {
+        if ((answer = solve(stdin, engine, &config)) == -1) {
+            stats_free(&stats);
             return EXIT_FAILURE;
         }
         fprintf(stdout, "%ld\n", answer);
+        if (config.stats) {
+            print_stats(stderr, "-", &stats, answer, stats_json);
+            stats_free(&stats);
+        }
     } else {
         FILE *file_ptr;
         long answer;
@@ -210,15 +1322,25 @@ int main(int argc, char **argv) {
                 return EXIT_FAILURE;
             }
 
-            if ((answer = solve(file_ptr)) == -1) {
+            if ((answer = solve(file_ptr, engine, &config)) == -1) {
                 fclose(file_ptr);
+                stats_free(&stats);
                 return EXIT_FAILURE;
             }
 
             fprintf(stdout, "%ld\n", answer);
             fclose(file_ptr);
+
+            if (config.stats) {
+                print_stats(stderr, filename, &stats, answer, stats_json);
+                stats_free(&stats);
+            }
         }
     }
 
+    if (config.stats) {
+        print_peak_memory(stderr, stats_json);
+    }
+
     return EXIT_SUCCESS;
 }